@@ -1,7 +1,7 @@
 import os
 from datetime import datetime, timezone
 
-from flask import Flask, render_template, request, Response
+from flask import Flask, render_template, request, Response, stream_with_context
 import requests
 from dotenv import load_dotenv
 
@@ -29,13 +29,23 @@ def _proxy_get(path: str, params: dict | None = None) -> Response:
     if params is None:
         params = dict(request.args)
 
+    # условный GET: ETag браузера уходит на сервер, 304 возвращается как есть
+    headers = {}
+    for h in ("If-None-Match", "Accept"):
+        if h in request.headers:
+            headers[h] = request.headers[h]
+
     try:
-        r = requests.get(url, params=params, timeout=TIMEOUT)
-        return Response(
+        r = requests.get(url, params=params, headers=headers, timeout=TIMEOUT)
+        resp = Response(
             r.content,
             status=r.status_code,
             content_type=r.headers.get("Content-Type", "application/json"),
         )
+        for h in ("ETag", "Cache-Control"):
+            if h in r.headers:
+                resp.headers[h] = r.headers[h]
+        return resp
     except requests.RequestException as e:
         return Response(
             f'{{"ok":false,"err":"proxy_error","details":"{str(e)}"}}'.encode("utf-8"),
@@ -59,6 +69,36 @@ def api_series():
     return _proxy_get("/api/series")
 
 
+@app.get("/api/stream")
+def api_stream():
+    """
+    Проксируем live-поток (SSE) без буферизации.
+    Сервер шлёт пинг раз в 15 с, поэтому таймаут чтения больше.
+    """
+    try:
+        r = requests.get(TEMP_SERVER_BASE + "/api/stream", stream=True, timeout=(TIMEOUT, 60))
+    except requests.RequestException as e:
+        return Response(
+            f'{{"ok":false,"err":"proxy_error","details":"{str(e)}"}}'.encode("utf-8"),
+            status=502,
+            content_type="application/json",
+        )
+    if r.status_code != 200:
+        return Response(r.content, status=r.status_code, content_type=r.headers.get("Content-Type"))
+
+    def gen():
+        try:
+            for chunk in r.iter_content(chunk_size=None):
+                yield chunk
+        except requests.RequestException:
+            pass
+        finally:
+            r.close()
+
+    return Response(stream_with_context(gen()), content_type="text/event-stream",
+                    headers={"Cache-Control": "no-cache"})
+
+
 @app.get("/api/series_all")
 def api_series_all():
     kind = request.args.get("kind", "hourly")
@@ -66,8 +106,9 @@ def api_series_all():
 
     now = int(datetime.now(tz=timezone.utc).timestamp())
 
+    # from округляем, чтобы параметры не менялись каждую секунду и работал ETag
     if kind == "hourly":
-        from_ts = now - 60 * 24 * 3600
+        from_ts = (now - 60 * 24 * 3600) // 3600 * 3600
     elif kind == "daily":
         y = datetime.now(tz=timezone.utc).year
         from_ts = int(datetime(y, 1, 1, tzinfo=timezone.utc).timestamp())
@@ -1,27 +1,119 @@
 #pragma once
+#include "tdigest.hpp"
 #include "timeutil.hpp"
 #include <optional>
+#include <type_traits>
 
-struct AvgOut {
+// Политики периода: округление timestamp к началу периода
+namespace period {
+struct Minute  { static timeutil::TP floor(const timeutil::TP& t) { return timeutil::floor_to_minute(t); } };
+struct FiveMin { static timeutil::TP floor(const timeutil::TP& t) { return timeutil::floor_to_5min(t); } };
+struct Hour    { static timeutil::TP floor(const timeutil::TP& t) { return timeutil::floor_to_hour(t); } };
+struct Day     { static timeutil::TP floor(const timeutil::TP& t) { return timeutil::floor_to_day(t); } };
+} // namespace period
+
+// Статистики периода. add(v, n): n - сколько значений было до v.
+// count ведёт сам накопитель, поэтому он есть всегда.
+namespace stats {
+struct Sum {
+    double sum = 0.0;
+    void add(double v, long long) { sum += v; }
+};
+
+struct Min {
+    double min = 0.0;
+    void add(double v, long long n) { if (n == 0 || v < min) min = v; }
+};
+
+struct Max {
+    double max = 0.0;
+    void add(double v, long long n) { if (n == 0 || v > max) max = v; }
+};
+
+// Дисперсия по Уэлфорду: устойчива к большим значениям, без суммы квадратов
+struct Variance {
+    double mean = 0.0, m2 = 0.0;
+    void add(double v, long long n) {
+        double d = v - mean;
+        mean += d / (double)(n + 1);
+        m2 += d * (v - mean);
+    }
+};
+
+struct First {
+    double first = 0.0;
+    void add(double v, long long n) { if (n == 0) first = v; }
+};
+
+struct Last {
+    double last = 0.0;
+    void add(double v, long long) { last = v; }
+};
+
+// Скетч квантилей; в отличие от остальных выделяет память
+struct Quantiles {
+    TDigest digest;
+    void add(double v, long long) { digest.add(v); }
+};
+} // namespace stats
+
+// Итог периода: начало, count и поля выбранных статистик
+template <class... Stats>
+struct PeriodOut : Stats... {
     timeutil::TP period_start{};
-    double avg{};
+    long long count = 0;
+
+    // avg() - только с stats::Sum, variance() - только с stats::Variance
+    double avg() const {
+        static_assert((std::is_same_v<Stats, stats::Sum> || ...), "avg() needs stats::Sum");
+        return count > 0 ? this->sum / (double)count : 0.0;
+    }
+    double variance() const {
+        static_assert((std::is_same_v<Stats, stats::Variance> || ...), "variance() needs stats::Variance");
+        return count > 1 ? this->m2 / (double)(count - 1) : 0.0;
+    }
 };
 
-// Накопитель среднего значения по периодам.
+// Накопитель статистик по периодам.
+// Period и набор Stats известны при компиляции: push целиком встраивается,
+// состояние - одна небольшая структура без указателей на функции.
+template <class Period, class... Stats>
 class Aggregator {
 public:
-    // period_floor округляет timestamp к началу часа/дня
-    explicit Aggregator(timeutil::TP (*period_floor)(const timeutil::TP&));
+    using Out = PeriodOut<Stats...>;
 
-    // Добавить измерение. Если период сменился - возвращает среднее за прошлый период.
-    std::optional<AvgOut> push(timeutil::TP ts, double value);
+    static timeutil::TP floor(const timeutil::TP& ts) { return Period::floor(ts); }
 
-private:
-    timeutil::TP (*m_floor)(const timeutil::TP&);
-    bool m_inited = false;
-    timeutil::TP m_start{};
-    double m_sum = 0.0;
-    long long m_cnt = 0;
+    // Добавить измерение. Если период сменился - возвращает итог прошлого периода.
+    std::optional<Out> push(timeutil::TP ts, double value) {
+        auto start = Period::floor(ts);
+
+        std::optional<Out> finished;
 
-    void reset(timeutil::TP newStart);
+        // Если начало периода изменилось это значит мы перешли в новый период
+        if (start != m_cur.period_start || m_cur.count == 0) {
+            if (m_cur.count > 0) finished = m_cur;
+            // Начинаем накапливать значения для нового периода.
+            m_cur = Out{};
+            m_cur.period_start = start;
+        }
+
+        (static_cast<Stats&>(m_cur).add(value, m_cur.count), ...);
+        m_cur.count++;
+
+        // Если период не сменился вернётся std::nullopt.
+        return finished;
+    }
+
+    // Незакрытый период (чтобы сохранить); nullopt - ещё ничего не накоплено
+    std::optional<Out> current() const {
+        if (m_cur.count == 0) return std::nullopt;
+        return m_cur;
+    }
+
+    // Продолжить период, сохранённый через current() до перезапуска
+    void resume(const Out& open) { m_cur = open; }
+
+private:
+    Out m_cur;
 };
@@ -0,0 +1,189 @@
+#include "block_index.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <mutex>
+
+void BlockStatsIndex::Agg::add(double v) {
+    if (count == 0) { min = v; max = v; }
+    else { min = std::min(min, v); max = std::max(max, v); }
+    sum += v;
+    count++;
+}
+
+void BlockStatsIndex::Agg::merge(const Agg& o) {
+    if (o.count == 0) return;
+    if (count == 0) { *this = o; return; }
+    min = std::min(min, o.min);
+    max = std::max(max, o.max);
+    sum += o.sum;
+    count += o.count;
+}
+
+BlockStatsIndex::BlockStatsIndex(std::int64_t block_sec, std::int64_t span_sec)
+    : m_block(block_sec > 0 ? block_sec : 60),
+      m_covered_from(std::numeric_limits<std::int64_t>::max()) {
+    // +2: частично удалённый головной блок и ещё не закрытый последний
+    m_slots = (std::size_t)(std::max<std::int64_t>(span_sec, 0) / m_block) + 2;
+    m_leaves = 1;
+    while (m_leaves < m_slots) m_leaves <<= 1;
+    m_key.assign(m_slots, -1);
+    m_tree.assign(2 * m_leaves, Agg{});
+}
+
+std::int64_t BlockStatsIndex::block_of(std::int64_t ts) const {
+    // деление вниз и для отрицательных ts
+    std::int64_t q = ts / m_block;
+    if (ts % m_block < 0) --q;
+    return q;
+}
+
+void BlockStatsIndex::update(std::size_t slot) {
+    std::size_t i = (slot + m_leaves) / 2;
+    while (i >= 1) {
+        Agg a = m_tree[2 * i];
+        a.merge(m_tree[2 * i + 1]);
+        m_tree[i] = a;
+        i /= 2;
+    }
+}
+
+void BlockStatsIndex::rebuild() {
+    for (std::size_t i = m_leaves - 1; i >= 1; --i) {
+        Agg a = m_tree[2 * i];
+        a.merge(m_tree[2 * i + 1]);
+        m_tree[i] = a;
+    }
+}
+
+// Освободить слот; его строки больше не считаются покрытыми
+void BlockStatsIndex::evict_slot(std::size_t slot) {
+    m_covered_from = std::max(m_covered_from, (m_key[slot] + 1) * m_block);
+    m_key[slot] = -1;
+    m_tree[m_leaves + slot] = Agg{};
+}
+
+void BlockStatsIndex::add_locked(const DbPoint& p, std::vector<std::size_t>* dirty) {
+    std::int64_t k = block_of(p.ts);
+    if (k <= m_newest - (std::int64_t)m_slots) return;   // точка старше кольца
+
+    if (k > m_newest) {
+        // слоты пропущенных блоков могут держать блоки с прошлого круга
+        std::int64_t first = std::max(m_newest + 1, k - (std::int64_t)m_slots + 1);
+        for (std::int64_t j = first; j <= k; ++j) {
+            std::size_t s = slot_of(j);
+            if (m_key[s] >= 0 && m_key[s] != j) {
+                evict_slot(s);
+                if (dirty) dirty->push_back(s);
+            }
+        }
+        m_newest = k;
+    }
+
+    std::size_t slot = slot_of(k);
+    m_key[slot] = k;
+    m_tree[m_leaves + slot].add(p.value);
+    if (dirty && (dirty->empty() || dirty->back() != slot)) dirty->push_back(slot);
+}
+
+void BlockStatsIndex::warm(Repo& repo, std::int64_t now) {
+    std::unique_lock<std::shared_mutex> lk(m_mu);
+    std::int64_t from = now - (std::int64_t)(m_slots - 2) * m_block;
+    m_covered_from = from;
+
+    repo.for_each("raw", from, std::numeric_limits<std::int64_t>::max(),
+                  [&](const DbPoint& p) { add_locked(p, nullptr); return true; });
+    rebuild();
+}
+
+void BlockStatsIndex::on_batch(const DbBatch& b) {
+    if (b.raw.empty()) return;
+    std::unique_lock<std::shared_mutex> lk(m_mu);
+    if (m_covered_from == std::numeric_limits<std::int64_t>::max()) m_covered_from = b.raw.front().ts;
+
+    // дерево пересчитываем один раз на затронутый блок, а не на каждую точку
+    std::vector<std::size_t> dirty;
+    for (const auto& p : b.raw) add_locked(p, &dirty);
+    for (auto s : dirty) update(s);
+}
+
+void BlockStatsIndex::on_retention(const std::string& kind, std::int64_t keep_from) {
+    if (kind != "raw") return;
+    std::unique_lock<std::shared_mutex> lk(m_mu);
+    m_covered_from = std::max(m_covered_from, keep_from);
+
+    // блоки, целиком лежащие раньше keep_from
+    std::int64_t first_kept = block_of(keep_from);
+    for (std::size_t s = 0; s < m_slots; ++s) {
+        if (m_key[s] >= 0 && m_key[s] < first_kept) {
+            m_key[s] = -1;
+            m_tree[m_leaves + s] = Agg{};
+            update(s);
+        }
+    }
+}
+
+BlockStatsIndex::Agg BlockStatsIndex::query(std::size_t lo, std::size_t hi) const {
+    Agg res;
+    std::size_t l = lo + m_leaves, r = hi + m_leaves + 1;
+    while (l < r) {
+        if (l & 1) res.merge(m_tree[l++]);
+        if (r & 1) res.merge(m_tree[--r]);
+        l /= 2;
+        r /= 2;
+    }
+    return res;
+}
+
+std::optional<DbStats> BlockStatsIndex::stats(std::int64_t from, std::int64_t to, const EdgeFn& edge) const {
+    Agg mid;
+    std::int64_t midFrom = 0, midTo = -1;   // [midFrom, midTo] посчитан по блокам
+    {
+        std::shared_lock<std::shared_mutex> lk(m_mu);
+        if (from < m_covered_from) return std::nullopt;
+
+        std::int64_t fb = block_of(from - 1) + 1;   // первый блок, начинающийся >= from
+        std::int64_t lb = block_of(to + 1) - 1;     // последний блок, кончающийся <= to
+
+        // целые блоки, которые реально лежат в кольце
+        lb = std::min(lb, m_newest);
+        fb = std::max(fb, m_newest - (std::int64_t)m_slots + 1);
+
+        if (fb <= lb) {
+            std::size_t a = slot_of(fb);
+            std::size_t b = slot_of(lb);
+            if (a <= b) mid = query(a, b);
+            else { mid = query(a, m_slots - 1); mid.merge(query(0, b)); }
+            midFrom = fb * m_block;
+            midTo = (lb + 1) * m_block - 1;
+        }
+    }
+
+    auto addEdge = [&](std::int64_t f, std::int64_t t) {
+        if (f > t) return;
+        DbStats e = edge(f, t);
+        if (e.count == 0) return;
+        Agg a;
+        a.count = e.count;
+        a.sum = e.avg * (double)e.count;
+        a.min = e.min;
+        a.max = e.max;
+        mid.merge(a);
+    };
+
+    if (midFrom > midTo) {
+        addEdge(from, to);
+    } else {
+        addEdge(from, midFrom - 1);
+        addEdge(midTo + 1, to);
+    }
+
+    DbStats s{};
+    s.count = mid.count;
+    if (mid.count > 0) {
+        s.min = mid.min;
+        s.max = mid.max;
+        s.avg = mid.sum / (double)mid.count;
+    }
+    return s;
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "ingest_observer.hpp"
+#include "repo.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <shared_mutex>
+#include <vector>
+
+// Индекс статистики по raw: время режется на блоки по block_sec секунд,
+// в каждом блоке count/sum/min/max, над блоками - дерево отрезков.
+// stats(from,to) = O(log n) по целым блокам + два краевых куска,
+// которые считает edge (по бд или окну в памяти).
+//
+// Блоки лежат в кольце на span_sec секунд (срок хранения raw).
+// Блоки, которые удалила retention или вытеснило кольцо, уходят целиком;
+// блок, удалённый частично, дальше используется только как краевой.
+class BlockStatsIndex : public IngestObserver {
+public:
+    using EdgeFn = std::function<DbStats(std::int64_t from, std::int64_t to)>;
+
+    BlockStatsIndex(std::int64_t block_sec, std::int64_t span_sec);
+
+    // Заполнение из raw_measurements при старте
+    void warm(Repo& repo, std::int64_t now);
+
+    void on_batch(const DbBatch& b) override;
+    void on_retention(const std::string& kind, std::int64_t keep_from) override;
+
+    // nullopt - from раньше, чем покрывает индекс
+    std::optional<DbStats> stats(std::int64_t from, std::int64_t to, const EdgeFn& edge) const;
+
+private:
+    struct Agg {
+        long long count = 0;
+        double sum = 0, min = 0, max = 0;
+        void add(double v);
+        void merge(const Agg& o);
+    };
+
+    std::int64_t m_block;
+    std::size_t m_slots;      // число блоков в кольце
+    std::size_t m_leaves;     // степень двойки >= m_slots
+
+    mutable std::shared_mutex m_mu;
+    std::vector<std::int64_t> m_key;  // номер блока (ts / block) в слоте, -1 - пусто
+    std::vector<Agg> m_tree;          // дерево отрезков, листья с m_leaves
+    // все строки бд с ts >= m_covered_from учтены в индексе
+    std::int64_t m_covered_from;
+    // самый новый блок; в кольце только блоки (m_newest - m_slots, m_newest]
+    std::int64_t m_newest = -1;
+
+    std::int64_t block_of(std::int64_t ts) const;
+    std::size_t slot_of(std::int64_t block) const { return (std::size_t)(block % (std::int64_t)m_slots); }
+    void add_locked(const DbPoint& p, std::vector<std::size_t>* dirty);
+    void evict_slot(std::size_t slot);
+    void update(std::size_t slot);
+    void rebuild();
+    Agg query(std::size_t lo, std::size_t hi) const;   // слоты [lo, hi]
+};
@@ -0,0 +1,86 @@
+#include "broadcaster.hpp"
+#include "json_writer.hpp"
+
+#include <algorithm>
+
+bool StreamSubscriber::wait(std::vector<Chunk>& out, std::chrono::milliseconds timeout) {
+    out.clear();
+    std::unique_lock<std::mutex> lk(m_mu);
+    m_cv.wait_for(lk, timeout, [&] { return m_closed || !m_q.empty(); });
+    if (m_closed) return false;
+
+    out.assign(m_q.begin(), m_q.end());
+    m_q.clear();
+    return true;
+}
+
+void StreamSubscriber::offer(const Chunk& c) {
+    {
+        std::lock_guard<std::mutex> lk(m_mu);
+        if (m_closed) return;
+        if (m_q.size() >= m_cap) {
+            // не успевает читать - отключаем, чтобы не копить память
+            m_closed = true;
+            m_q.clear();
+        } else {
+            m_q.push_back(c);
+        }
+    }
+    m_cv.notify_one();
+}
+
+void StreamSubscriber::close() {
+    {
+        std::lock_guard<std::mutex> lk(m_mu);
+        m_closed = true;
+    }
+    m_cv.notify_one();
+}
+
+std::shared_ptr<StreamSubscriber> Broadcaster::subscribe() {
+    std::lock_guard<std::mutex> lk(m_mu);
+    if (m_subs.size() >= m_max) return nullptr;
+    auto s = std::make_shared<StreamSubscriber>(m_buffer);
+    m_subs.push_back(s);
+    return s;
+}
+
+void Broadcaster::unsubscribe(const std::shared_ptr<StreamSubscriber>& s) {
+    s->close();
+    std::lock_guard<std::mutex> lk(m_mu);
+    m_subs.erase(std::remove(m_subs.begin(), m_subs.end(), s), m_subs.end());
+}
+
+static void put_events(JsonWriter& w, const char* event, const std::vector<DbPoint>& pts) {
+    for (const auto& p : pts) {
+        w.raw("event: ").raw(event).raw("\ndata: {\"ts\":").i64(p.ts)
+         .raw(",\"value\":").f64(p.value).raw("}\n\n");
+    }
+}
+
+// Закрытый период: value - среднее, плюс count/min/max
+static void put_events(JsonWriter& w, const std::string& event, const std::vector<DbRollup>& rs) {
+    for (const auto& r : rs) {
+        w.raw("event: ").raw(event).raw("\ndata: {\"ts\":").i64(r.ts)
+         .raw(",\"value\":").f64(r.avg()).raw(",\"count\":").i64(r.count)
+         .raw(",\"min\":").f64(r.min).raw(",\"max\":").f64(r.max).raw("}\n\n");
+    }
+}
+
+void Broadcaster::on_batch(const DbBatch& b) {
+    std::vector<std::shared_ptr<StreamSubscriber>> subs;
+    {
+        std::lock_guard<std::mutex> lk(m_mu);
+        if (m_subs.empty()) return;
+        subs = m_subs;
+    }
+
+    JsonWriter w(64 * b.raw.size() + 128 * (b.m1.size() + b.m5.size() + b.hourly.size() + b.daily.size()));
+    put_events(w, "raw", b.raw);
+    for (const auto& kind : Repo::kinds()) {
+        if (auto* r = b.rollups(kind)) put_events(w, kind, *r);
+    }
+    auto chunk = std::make_shared<const std::string>(w.str());
+
+    for (auto& s : subs) s->offer(chunk);
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include "ingest_observer.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Подписчик live-потока: ограниченная очередь готовых SSE-кусков
+class StreamSubscriber {
+public:
+    using Chunk = std::shared_ptr<const std::string>;
+
+    explicit StreamSubscriber(std::size_t cap) : m_cap(cap) {}
+
+    // Ждёт куски до timeout (пустой out - таймаут).
+    // false - подписчик отключён: не успевал читать или поток закрыт
+    bool wait(std::vector<Chunk>& out, std::chrono::milliseconds timeout);
+
+private:
+    friend class Broadcaster;
+
+    std::mutex m_mu;
+    std::condition_variable m_cv;
+    std::deque<Chunk> m_q;
+    std::size_t m_cap;
+    bool m_closed = false;
+
+    void offer(const Chunk& c);
+    void close();
+};
+
+// Рассылка новых измерений и закрытых часов/дней всем подписчикам.
+// Пачка форматируется в SSE один раз, подписчики получают общий кусок.
+// Медленный подписчик, у которого переполнилась очередь, отключается.
+class Broadcaster : public IngestObserver {
+public:
+    Broadcaster(std::size_t buffer, std::size_t max_subscribers)
+        : m_buffer(buffer ? buffer : 1), m_max(max_subscribers) {}
+
+    // nullptr - подписчиков уже максимум
+    std::shared_ptr<StreamSubscriber> subscribe();
+    void unsubscribe(const std::shared_ptr<StreamSubscriber>& s);
+
+    std::size_t max_subscribers() const { return m_max; }
+
+    void on_batch(const DbBatch& b) override;
+
+private:
+    std::size_t m_buffer;
+    std::size_t m_max;
+
+    std::mutex m_mu;
+    std::vector<std::shared_ptr<StreamSubscriber>> m_subs;
+};
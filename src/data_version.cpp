@@ -0,0 +1,51 @@
+#include "data_version.hpp"
+
+const DataVersions::Slot* DataVersions::slot(const std::string& kind) const {
+    const auto& kinds = Repo::kinds();
+    for (std::size_t i = 0; i < kinds.size(); ++i) {
+        if (kinds[i] == kind) return &m_slots[i];
+    }
+    return nullptr;
+}
+
+DataVersions::Slot* DataVersions::slot(const std::string& kind) {
+    return const_cast<Slot*>(static_cast<const DataVersions*>(this)->slot(kind));
+}
+
+void DataVersions::warm(Repo& repo) {
+    for (const auto& kind : Repo::kinds()) {
+        auto ts = repo.max_ts(kind);
+        // пустая таблица: всё, что появится, будет новее любого ts
+        slot(kind)->last_ts.store(ts ? *ts : INT64_MIN, std::memory_order_relaxed);
+    }
+}
+
+// ts пишем до поколения: кто увидел новое поколение, увидит и новый ts
+void DataVersions::bump(Slot& s, bool any, std::int64_t last) {
+    if (!any) return;
+    s.last_ts.store(last, std::memory_order_relaxed);
+    s.gen.fetch_add(1, std::memory_order_release);
+}
+
+void DataVersions::on_batch(const DbBatch& b) {
+    for (const auto& kind : Repo::kinds()) {
+        auto* s = slot(kind);
+        if (!s) continue;
+        if (auto* r = b.rollups(kind)) bump(*s, !r->empty(), r->empty() ? 0 : r->back().ts);
+        else bump(*s, !b.raw.empty(), b.raw.empty() ? 0 : b.raw.back().ts);
+    }
+}
+
+void DataVersions::on_retention(const std::string& kind, std::int64_t) {
+    if (auto* s = slot(kind)) s->gen.fetch_add(1, std::memory_order_release);
+}
+
+std::uint64_t DataVersions::generation(const std::string& kind) const {
+    auto* s = slot(kind);
+    return s ? s->gen.load(std::memory_order_acquire) : 0;
+}
+
+std::int64_t DataVersions::last_ts(const std::string& kind) const {
+    auto* s = slot(kind);
+    return s ? s->last_ts.load(std::memory_order_relaxed) : INT64_MAX;
+}
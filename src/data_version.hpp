@@ -0,0 +1,41 @@
+#pragma once
+#include "ingest_observer.hpp"
+#include "repo.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Счётчики записи по таблицам (kind из Repo::kinds()) для ETag.
+// Поколение растёт на каждую записанную пачку и на каждую очистку;
+// пока оно не изменилось, ответ на тот же запрос тот же самый.
+class DataVersions : public IngestObserver {
+public:
+    // epoch отличает запуски: после рестарта старые ETag не совпадут
+    explicit DataVersions(std::uint64_t epoch) : m_epoch(epoch) {}
+
+    // Последние ts по таблицам из бд
+    void warm(Repo& repo);
+
+    void on_batch(const DbBatch& b) override;
+    void on_retention(const std::string& kind, std::int64_t keep_from) override;
+
+    std::uint64_t epoch() const { return m_epoch; }
+    std::uint64_t generation(const std::string& kind) const;
+
+    // Последний записанный ts; INT64_MAX - неизвестно
+    std::int64_t last_ts(const std::string& kind) const;
+
+private:
+    struct Slot {
+        std::atomic<std::uint64_t> gen{0};
+        std::atomic<std::int64_t> last_ts{INT64_MAX};
+    };
+
+    std::uint64_t m_epoch;
+    Slot m_slots[Repo::kKindCount];   // по Repo::kinds()
+
+    const Slot* slot(const std::string& kind) const;
+    Slot* slot(const std::string& kind);
+    static void bump(Slot& s, bool any, std::int64_t last);
+};
@@ -0,0 +1,133 @@
+#include "downsample.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+bool parse_downsample_method(const std::string& s, DownsampleMethod& out) {
+    if (s == "minmax") out = DownsampleMethod::MinMax;
+    else if (s == "lttb") out = DownsampleMethod::Lttb;
+    else if (s == "avg") out = DownsampleMethod::Avg;
+    else return false;
+    return true;
+}
+
+Downsampler::Downsampler(DownsampleMethod method, std::int64_t from, std::int64_t to, int points)
+    : m_method(method), m_from(from) {
+    m_points = (std::size_t)std::max(points, 3);
+
+    // minmax даёт 2 точки на интервал, LTTB добавляет первую и последнюю
+    if (m_method == DownsampleMethod::MinMax) m_buckets = m_points / 2;
+    else if (m_method == DownsampleMethod::Lttb) m_buckets = m_points - 2;
+    else m_buckets = m_points;
+
+    m_width = (double)(std::max<std::int64_t>(to - from, 0) + 1) / (double)m_buckets;
+    m_out.reserve(m_points);
+}
+
+std::size_t Downsampler::bucket_of(std::int64_t ts) const {
+    double k = std::floor((double)(ts - m_from) / m_width);
+    if (k < 0) return 0;
+    return std::min((std::size_t)k, m_buckets - 1);
+}
+
+void Downsampler::push(const DbPoint& p) {
+    if (m_passthrough) {
+        if (m_out.size() < m_points) { m_out.push_back(p); return; }
+
+        // точек больше, чем просили: прогоняем накопленное через интервалы
+        m_passthrough = false;
+        std::vector<DbPoint> buf;
+        buf.swap(m_out);
+        for (const auto& q : buf) add(q);
+    }
+    add(p);
+}
+
+void Downsampler::add(const DbPoint& p) {
+    if (m_method == DownsampleMethod::Lttb) {
+        m_last = p;
+        if (!m_has_a) {
+            // первая точка идёт в ответ всегда
+            m_out.push_back(p);
+            m_a = p;
+            m_has_a = true;
+            return;
+        }
+    }
+
+    std::size_t idx = bucket_of(p.ts);
+    if (m_pending.empty() || m_pending.back().idx != idx) {
+        // LTTB нужен следующий интервал, чтобы выбрать точку в текущем
+        std::size_t keep = m_method == DownsampleMethod::Lttb ? 2 : 1;
+        while (m_pending.size() >= keep) close_front(false);
+        m_pending.push_back(Bucket{});
+        m_pending.back().idx = idx;
+    }
+
+    Bucket& b = m_pending.back();
+    if (b.cnt == 0) { b.min = p; b.max = p; }
+    else {
+        if (p.value < b.min.value) b.min = p;
+        if (p.value > b.max.value) b.max = p;
+    }
+    b.sum_ts += (double)p.ts;
+    b.sum_v += p.value;
+    b.cnt++;
+    if (m_method == DownsampleMethod::Lttb) b.pts.push_back(p);
+}
+
+// Точка интервала с наибольшей площадью треугольника (a, p, c)
+void Downsampler::lttb_select(Bucket& b, double c_ts, double c_v) {
+    double best = -1;
+    DbPoint sel{};
+    for (const auto& p : b.pts) {
+        double area = std::fabs(((double)m_a.ts - c_ts) * (p.value - m_a.value) -
+                                ((double)m_a.ts - (double)p.ts) * (c_v - m_a.value));
+        if (area > best) { best = area; sel = p; }
+    }
+    if (best < 0) return;
+    m_out.push_back(sel);
+    m_a = sel;
+}
+
+void Downsampler::close_front(bool last) {
+    Bucket& b = m_pending.front();
+
+    switch (m_method) {
+    case DownsampleMethod::Avg:
+        m_out.push_back({(std::int64_t)std::llround(b.sum_ts / (double)b.cnt), b.sum_v / (double)b.cnt});
+        break;
+
+    case DownsampleMethod::MinMax:
+        if (b.min.ts == b.max.ts && b.min.value == b.max.value) {
+            m_out.push_back(b.min);
+        } else if (b.min.ts <= b.max.ts) {
+            m_out.push_back(b.min);
+            m_out.push_back(b.max);
+        } else {
+            m_out.push_back(b.max);
+            m_out.push_back(b.min);
+        }
+        break;
+
+    case DownsampleMethod::Lttb:
+        if (last) {
+            // последний интервал: третья вершина - последняя точка, её саму не выбираем
+            b.pts.pop_back();
+            lttb_select(b, (double)m_last.ts, m_last.value);
+            m_out.push_back(m_last);
+        } else {
+            const Bucket& c = m_pending[1];
+            lttb_select(b, c.sum_ts / (double)c.cnt, c.sum_v / (double)c.cnt);
+        }
+        break;
+    }
+    m_pending.pop_front();
+}
+
+std::vector<DbPoint> Downsampler::finish() {
+    if (!m_passthrough) {
+        while (!m_pending.empty()) close_front(m_pending.size() == 1);
+    }
+    return std::move(m_out);
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "repo.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+enum class DownsampleMethod {
+    MinMax,  // в каждом интервале минимум и максимум
+    Lttb,    // Largest-Triangle-Three-Buckets
+    Avg,     // среднее по интервалу
+};
+
+bool parse_downsample_method(const std::string& s, DownsampleMethod& out);
+
+// Прореживание ряда за один проход: [from, to] делится на равные интервалы
+// времени, на выходе не больше points точек, покрывающих весь период.
+// Точки подаются по возрастанию ts. Если точек не больше points,
+// они возвращаются как есть.
+class Downsampler {
+public:
+    Downsampler(DownsampleMethod method, std::int64_t from, std::int64_t to, int points);
+
+    void push(const DbPoint& p);
+    std::vector<DbPoint> finish();
+
+private:
+    struct Bucket {
+        std::size_t idx = 0;
+        std::vector<DbPoint> pts;      // только для LTTB
+        double sum_ts = 0, sum_v = 0;
+        long long cnt = 0;
+        DbPoint min{}, max{};
+    };
+
+    DownsampleMethod m_method;
+    std::int64_t m_from;
+    std::size_t m_points;
+    std::size_t m_buckets;
+    double m_width;
+
+    std::vector<DbPoint> m_out;
+    bool m_passthrough = true;       // пока точек <= points, копим как есть
+    std::deque<Bucket> m_pending;
+
+    // LTTB: последняя выбранная и последняя пришедшая точки
+    DbPoint m_a{};
+    DbPoint m_last{};
+    bool m_has_a = false;
+
+    std::size_t bucket_of(std::int64_t ts) const;
+    void add(const DbPoint& p);
+    void close_front(bool last);
+    void lttb_select(Bucket& b, double c_ts, double c_v);
+};
@@ -0,0 +1,169 @@
+#include "gorilla.hpp"
+
+#include <cstring>
+
+static std::uint64_t bits_of(double v) {
+    std::uint64_t u;
+    std::memcpy(&u, &v, sizeof(u));
+    return u;
+}
+
+static double double_of(std::uint64_t u) {
+    double v;
+    std::memcpy(&v, &u, sizeof(v));
+    return v;
+}
+
+// x != 0
+static unsigned clz64(std::uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return (unsigned)__builtin_clzll(x);
+#else
+    unsigned n = 0;
+    for (std::uint64_t m = 1ULL << 63; !(x & m); m >>= 1) ++n;
+    return n;
+#endif
+}
+
+static unsigned ctz64(std::uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return (unsigned)__builtin_ctzll(x);
+#else
+    unsigned n = 0;
+    for (std::uint64_t m = 1; !(x & m); m <<= 1) ++n;
+    return n;
+#endif
+}
+
+// Младшие n бит v, старшим вперёд
+void GorillaEncoder::put(std::uint64_t v, unsigned n) {
+    while (n > 0) {
+        if (m_bits == 0) m_buf.push_back(0);
+        unsigned room = 8 - m_bits;
+        unsigned take = n < room ? n : room;
+        std::uint8_t part = (std::uint8_t)((v >> (n - take)) & ((1u << take) - 1));
+        m_buf.back() |= (std::uint8_t)(part << (room - take));
+        m_bits = (m_bits + take) & 7;
+        n -= take;
+    }
+}
+
+void GorillaEncoder::append(std::int64_t ts, double value) {
+    std::uint64_t v = bits_of(value);
+
+    if (m_count == 0) {
+        put((std::uint64_t)ts, 64);
+        put(v, 64);
+    } else {
+        std::int64_t delta = ts - m_prev_ts;
+        std::int64_t dod = delta - m_prev_delta;
+        if (dod == 0) put(0, 1);
+        else if (dod >= -64 && dod <= 63) { put(0b10, 2); put((std::uint64_t)dod, 7); }
+        else if (dod >= -256 && dod <= 255) { put(0b110, 3); put((std::uint64_t)dod, 9); }
+        else if (dod >= -2048 && dod <= 2047) { put(0b1110, 4); put((std::uint64_t)dod, 12); }
+        else { put(0b1111, 4); put((std::uint64_t)dod, 64); }
+        m_prev_delta = delta;
+
+        std::uint64_t x = v ^ m_prev_v;
+        if (x == 0) {
+            put(0, 1);
+        } else {
+            unsigned lead = clz64(x), trail = ctz64(x);
+            if (lead > 31) lead = 31;   // на ведущие нули 5 бит
+            if (m_lead != 64 && lead >= m_lead && trail >= m_trail) {
+                put(0b10, 2);
+                put(x >> m_trail, 64 - m_lead - m_trail);
+            } else {
+                unsigned len = 64 - lead - trail;
+                put(0b11, 2);
+                put(lead, 5);
+                put(len - 1, 6);
+                put(x >> trail, len);
+                m_lead = lead;
+                m_trail = trail;
+            }
+        }
+    }
+
+    m_prev_ts = ts;
+    m_prev_v = v;
+    m_count++;
+}
+
+void GorillaEncoder::drop_front(std::size_t n) {
+    m_buf.erase(m_buf.begin(), m_buf.begin() + (std::ptrdiff_t)n);
+}
+
+void GorillaEncoder::clear() {
+    *this = GorillaEncoder{};
+}
+
+bool GorillaDecoder::get(unsigned n, std::uint64_t& out) {
+    if (m_pos + n > m_size * 8) return false;
+    out = 0;
+    while (n > 0) {
+        std::size_t byte = m_pos >> 3;
+        unsigned off = (unsigned)(m_pos & 7);
+        unsigned room = 8 - off;
+        unsigned take = n < room ? n : room;
+        std::uint64_t part = (m_data[byte] >> (room - take)) & ((1u << take) - 1);
+        out = (out << take) | part;
+        m_pos += take;
+        n -= take;
+    }
+    return true;
+}
+
+// n-битное число в дополнительном коде
+static std::int64_t sign_extend(std::uint64_t v, unsigned n) {
+    if (n < 64 && (v & (1ULL << (n - 1)))) v |= ~0ULL << n;
+    return (std::int64_t)v;
+}
+
+bool GorillaDecoder::next(std::int64_t& ts, double& value) {
+    if (m_left == 0) return false;
+    std::uint64_t u = 0;
+
+    if (m_first) {
+        if (!get(64, u)) return false;
+        m_prev_ts = (std::int64_t)u;
+        if (!get(64, m_prev_v)) return false;
+        m_first = false;
+    } else {
+        // ts: число единиц в префиксе задаёт ширину dod
+        static const unsigned widths[] = {0, 7, 9, 12, 64};
+        unsigned ones = 0;
+        while (ones < 4) {
+            if (!get(1, u)) return false;
+            if (u == 0) break;
+            ++ones;
+        }
+        std::int64_t dod = 0;
+        if (ones > 0) {
+            if (!get(widths[ones], u)) return false;
+            dod = sign_extend(u, widths[ones]);
+        }
+        m_prev_delta += dod;
+        m_prev_ts += m_prev_delta;
+
+        // value
+        if (!get(1, u)) return false;
+        if (u == 1) {
+            if (!get(1, u)) return false;
+            if (u == 1) {
+                std::uint64_t lead = 0, len = 0;
+                if (!get(5, lead) || !get(6, len)) return false;
+                m_lead = (unsigned)lead;
+                m_trail = 64 - m_lead - (unsigned)(len + 1);
+            }
+            unsigned len = 64 - m_lead - m_trail;
+            if (!get(len, u)) return false;
+            m_prev_v ^= u << m_trail;
+        }
+    }
+
+    ts = m_prev_ts;
+    value = double_of(m_prev_v);
+    m_left--;
+    return true;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Сжатие ряда (ts, value) в духе Gorilla (Facebook, 2015).
+// Биты пишутся старшим вперёд. Первая точка - 64 бита ts и 64 бита value,
+// дальше ts как delta-of-delta:
+//   0                     dod == 0
+//   10   + 7 бит          dod в [-64, 63] (дополнительный код)
+//   110  + 9 бит          dod в [-256, 255]
+//   1110 + 12 бит         dod в [-2048, 2047]
+//   1111 + 64 бита        остальное
+// value как XOR с предыдущим:
+//   0                     xor == 0
+//   10 + значащие биты    в окне предыдущего xor
+//   11 + 5 бит ведущих нулей + 6 бит (длина-1) + значащие биты
+// Число точек в поток не пишется - его хранит тот, кто хранит поток.
+class GorillaEncoder {
+public:
+    void append(std::int64_t ts, double v);
+
+    std::size_t count() const { return m_count; }
+
+    // Все байты потока; последний может быть заполнен частично
+    const std::vector<std::uint8_t>& bytes() const { return m_buf; }
+
+    // Для потоковой отдачи: сколько байт уже не изменится и выкинуть их из буфера
+    std::size_t full_bytes() const { return m_bits == 0 ? m_buf.size() : m_buf.size() - 1; }
+    void drop_front(std::size_t n);
+
+    // Запас буфера: capacity() для учёта памяти, shrink_to_fit() - когда поток закончен
+    std::size_t capacity() const { return m_buf.capacity(); }
+    void shrink_to_fit() { m_buf.shrink_to_fit(); }
+
+    void clear();
+
+private:
+    std::vector<std::uint8_t> m_buf;
+    unsigned m_bits = 0;          // сколько бит занято в последнем байте (0 - байт не начат)
+    std::size_t m_count = 0;
+
+    std::int64_t m_prev_ts = 0;
+    std::int64_t m_prev_delta = 0;
+    std::uint64_t m_prev_v = 0;
+    unsigned m_lead = 64, m_trail = 0;   // окно предыдущего xor; 64 - окна ещё нет
+
+    void put(std::uint64_t v, unsigned n);
+};
+
+class GorillaDecoder {
+public:
+    GorillaDecoder(const std::uint8_t* data, std::size_t size, std::size_t count)
+        : m_data(data), m_size(size), m_left(count) {}
+
+    // false - точки кончились или поток битый
+    bool next(std::int64_t& ts, double& v);
+
+private:
+    const std::uint8_t* m_data;
+    std::size_t m_size;
+    std::size_t m_left;
+    std::size_t m_pos = 0;        // позиция в битах
+    bool m_first = true;
+
+    std::int64_t m_prev_ts = 0;
+    std::int64_t m_prev_delta = 0;
+    std::uint64_t m_prev_v = 0;
+    unsigned m_lead = 0, m_trail = 0;
+
+    bool get(unsigned n, std::uint64_t& out);
+};
+
+// v ровно в тысячных: m / 1000 == v, и m - целое, точное в double.
+// У десятичных дробей XOR соседних double почти весь из значащих бит,
+// а у целых m - несколько младших: такие ряды выгоднее хранить как m
+inline bool gorilla_to_milli(double v, double& m) {
+    m = std::round(v * 1000.0);
+    return std::fabs(m) < 9007199254740992.0 && m / 1000.0 == v;
+}
@@ -0,0 +1,135 @@
+#include "hot_window.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <mutex>
+
+HotWindow::HotWindow(std::int64_t window_sec, std::size_t capacity)
+    : m_window(window_sec), m_cap(capacity ? capacity : 1), m_ts(m_cap), m_val(m_cap) {}
+
+// Первая позиция (от головы) с ts >= заданного
+std::size_t HotWindow::lower_bound(std::int64_t ts) const {
+    std::size_t lo = 0, hi = m_size;
+    while (lo < hi) {
+        std::size_t mid = (lo + hi) / 2;
+        if (m_ts[at(mid)] < ts) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+void HotWindow::push_locked(const DbPoint& p) {
+    if (m_size == m_cap) {
+        // вытесняем самую старую: строки с её ts больше не все в окне
+        m_covered_from = std::max(m_covered_from, m_ts[m_head] + 1);
+        m_head = (m_head + 1) % m_cap;
+        --m_size;
+    }
+    std::size_t i = at(m_size);
+    m_ts[i] = p.ts;
+    m_val[i] = p.value;
+    ++m_size;
+
+    // обрезка по времени
+    std::int64_t cut = p.ts - m_window;
+    while (m_size > 0 && m_ts[m_head] < cut) {
+        m_head = (m_head + 1) % m_cap;
+        --m_size;
+    }
+    m_covered_from = std::max(m_covered_from, cut);
+}
+
+void HotWindow::publish_latest(const DbPoint& p) {
+    // писатель один: нечётный seq - идёт запись
+    auto s = m_seq.load(std::memory_order_relaxed);
+    m_seq.store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_last_ts.store(p.ts, std::memory_order_relaxed);
+    m_last_val.store(p.value, std::memory_order_relaxed);
+    m_seq.store(s + 2, std::memory_order_release);
+}
+
+void HotWindow::warm(Repo& repo, std::int64_t now) {
+    std::unique_lock<std::shared_mutex> lk(m_mu);
+    m_head = 0;
+    m_size = 0;
+    m_covered_from = now - m_window;
+
+    DbPoint last{};
+    bool any = false;
+    repo.for_each("raw", now - m_window, std::numeric_limits<std::int64_t>::max(),
+                  [&](const DbPoint& p) { push_locked(p); last = p; any = true; return true; });
+    if (any) publish_latest(last);
+}
+
+void HotWindow::append(const std::vector<DbPoint>& pts) {
+    if (pts.empty()) return;
+    {
+        std::unique_lock<std::shared_mutex> lk(m_mu);
+        // до прогрева окно ничего не покрывает
+        if (m_covered_from == std::numeric_limits<std::int64_t>::max()) m_covered_from = pts.front().ts;
+        for (const auto& p : pts) push_locked(p);
+    }
+    publish_latest(pts.back());
+}
+
+std::optional<DbPoint> HotWindow::latest() const {
+    for (;;) {
+        auto s1 = m_seq.load(std::memory_order_acquire);
+        if (s1 == 0) return std::nullopt;   // ещё ничего не публиковали
+        if (s1 & 1) continue;
+
+        DbPoint p;
+        p.ts = m_last_ts.load(std::memory_order_relaxed);
+        p.value = m_last_val.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+
+        if (m_seq.load(std::memory_order_relaxed) == s1) return p;
+    }
+}
+
+std::optional<DbStats> HotWindow::stats(std::int64_t from, std::int64_t to) const {
+    std::shared_lock<std::shared_mutex> lk(m_mu);
+    if (from < m_covered_from) return std::nullopt;
+
+    DbStats s{};
+    double sum = 0;
+    for (std::size_t i = lower_bound(from); i < m_size; ++i) {
+        std::size_t k = at(i);
+        if (m_ts[k] > to) break;
+        double v = m_val[k];
+        if (s.count == 0) { s.min = v; s.max = v; }
+        else { s.min = std::min(s.min, v); s.max = std::max(s.max, v); }
+        sum += v;
+        s.count++;
+    }
+    if (s.count > 0) s.avg = sum / (double)s.count;
+    return s;
+}
+
+std::optional<std::vector<DbPoint>> HotWindow::series(std::int64_t from, std::int64_t to, int limit) const {
+    if (limit <= 0) limit = 1000;
+    std::shared_lock<std::shared_mutex> lk(m_mu);
+    if (from < m_covered_from) return std::nullopt;
+
+    std::vector<DbPoint> out;
+    for (std::size_t i = lower_bound(from); i < m_size && (int)out.size() < limit; ++i) {
+        std::size_t k = at(i);
+        if (m_ts[k] > to) break;
+        out.push_back({m_ts[k], m_val[k]});
+    }
+    return out;
+}
+
+bool HotWindow::for_each(std::int64_t from, std::int64_t to,
+                         const std::function<bool(const DbPoint&)>& fn) const {
+    std::shared_lock<std::shared_mutex> lk(m_mu);
+    if (from < m_covered_from) return false;
+
+    for (std::size_t i = lower_bound(from); i < m_size; ++i) {
+        std::size_t k = at(i);
+        if (m_ts[k] > to) break;
+        if (!fn(DbPoint{m_ts[k], m_val[k]})) break;
+    }
+    return true;
+}
@@ -0,0 +1,61 @@
+#pragma once
+#include "ingest_observer.hpp"
+#include "repo.hpp"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <shared_mutex>
+#include <vector>
+
+// Последние window_sec секунд raw-измерений в памяти.
+// Колоночное кольцо фиксированной ёмкости (ts и value в отдельных массивах).
+// Пишет один поток (запись в бд), читают HTTP потоки.
+//
+// Окно отвечает на запрос, только если в нём есть все строки бд с ts >= from,
+// иначе возвращает std::nullopt и запрос идёт в SQLite.
+class HotWindow : public IngestObserver {
+public:
+    HotWindow(std::int64_t window_sec, std::size_t capacity);
+
+    // Прогрев из raw_measurements при старте
+    void warm(Repo& repo, std::int64_t now);
+
+    // Добавить точки, уже записанные в бд (ts не убывают)
+    void append(const std::vector<DbPoint>& pts);
+    void on_batch(const DbBatch& b) override { append(b.raw); }
+
+    // Последняя точка: seqlock, без блокировок
+    std::optional<DbPoint> latest() const;
+
+    std::optional<DbStats> stats(std::int64_t from, std::int64_t to) const;
+    std::optional<std::vector<DbPoint>> series(std::int64_t from, std::int64_t to, int limit) const;
+
+    // Обход точек периода (fn вернул false - стоп).
+    // false - окно период не покрывает, fn не вызывался
+    bool for_each(std::int64_t from, std::int64_t to, const std::function<bool(const DbPoint&)>& fn) const;
+
+private:
+    std::int64_t m_window;
+    std::size_t m_cap;
+
+    mutable std::shared_mutex m_mu;
+    std::vector<std::int64_t> m_ts;
+    std::vector<double> m_val;
+    std::size_t m_head = 0;    // индекс самой старой точки
+    std::size_t m_size = 0;
+    // все строки бд с ts >= m_covered_from есть в окне
+    std::int64_t m_covered_from = INT64_MAX;
+
+    // seqlock последней точки
+    std::atomic<std::uint64_t> m_seq{0};
+    std::atomic<std::int64_t> m_last_ts{0};
+    std::atomic<double> m_last_val{0};
+
+    std::size_t at(std::size_t i) const { return (m_head + i) % m_cap; }
+    std::size_t lower_bound(std::int64_t ts) const;
+    void push_locked(const DbPoint& p);
+    void publish_latest(const DbPoint& p);
+};
@@ -1,27 +1,294 @@
 #include "http.hpp"
+#include "downsample.hpp"
+#include "gorilla.hpp"
+#include "json_writer.hpp"
 #include "../third_party/httplib.h"
-#include <sstream>
+#include <algorithm>
+#include <limits>
 
 // endpoints:
 //
 // GET /api/current
 //   возвращает последнюю температуру (latest_raw)
 //
-// GET /api/stats?kind=raw|hourly|daily&from=UNIX&to=UNIX
-//   возвращает count/min/max/avg
+// GET /api/stats?kind=raw|1m|5m|hourly|daily&from=UNIX&to=UNIX
+//   возвращает count/min/max/avg; у свёрток count - число измерений, avg взвешенное
+// GET /api/stats?...&quantiles=0.5,0.95,0.99   (kind=raw|hourly|daily)
+//   ещё "quantiles":{"0.5":...,...} по скетчам t-digest и "quantile_count" - по скольким
+//   измерениям они посчитаны (строки свёрток без скетча не входят)
 //
 // GET /api/series?kind=...&from=...&to=...&limit=1000
 //   возвращает список точек [{ts,value},...]
+// GET /api/series?kind=...&from=...&to=...&points=N&method=minmax|lttb|avg
+//   не больше N точек (N <= 10000, иначе 400), прореженных по всему периоду
+// GET /api/series?resolution=auto&from=...&to=...&points=N[&method=...]
+//   kind выбирается сам: самая грубая свёртка, дающая за период не меньше N точек;
+//   выбранный kind - в поле "kind" и заголовке X-Series-Kind
+//
+// format=bin или Accept: application/octet-stream - тот же ряд в двоичном виде:
+//   "TSG1" | поток Gorilla (см. gorilla.hpp) | u32 LE число точек
+//
+// GET /api/stream
+//   Server-Sent Events: event raw на каждое измерение, 1m/5m/hourly/daily на закрытый период,
+//   data: {"ts":...,"value":...} (у свёрток ещё count/min/max)
+//
+// GET /api/ingest
+//   состояние очереди приёма: depth/capacity/dropped/spilled
+//
+// GET /api/rolling?window=300[&stats=count,avg,min,max]
+//   скользящая статистика raw за последние window секунд из памяти, без бд;
+//   window - одно из --rolling-windows (список - в "windows" ответа 404)
+//
+// current/stats/series отдают ETag (поколение записи таблицы + параметры);
+// If-None-Match с тем же ETag -> 304 без обращения к данным.
+
+// Буфер ответа на поток HTTP: после первых запросов память не выделяется
+static JsonWriter& json_buf() {
+    thread_local JsonWriter w(4096);
+    w.clear();
+    return w;
+}
+
+static void write_point(JsonWriter& w, const DbPoint& p) {
+    w.raw("{\"ts\":").i64(p.ts).raw(",\"value\":").f64(p.value).raw("}");
+}
+
+static const char kBinMagic[4] = {'T', 'S', 'G', '1'};
+
+static bool wants_bin(const httplib::Request& req) {
+    if (req.has_param("format")) return req.get_param_value("format") == "bin";
+    return req.get_header_value("Accept").find("application/octet-stream") != std::string::npos;
+}
+
+static void put_u32_le(std::string& out, std::uint32_t v) {
+    for (int i = 0; i < 4; ++i) out.push_back((char)((v >> (8 * i)) & 0xff));
+}
+
+static std::string encode_bin(const std::vector<DbPoint>& pts) {
+    GorillaEncoder enc;
+    for (const auto& p : pts) enc.append(p.ts, p.value);
+
+    std::string out(kBinMagic, sizeof(kBinMagic));
+    out.append((const char*)enc.bytes().data(), enc.bytes().size());
+    put_u32_le(out, (std::uint32_t)enc.count());
+    return out;
+}
+
+// FNV-1a
+static std::uint64_t hash_str(const std::string& s) {
+    std::uint64_t h = 1469598103934665603ULL;
+    for (unsigned char c : s) { h ^= c; h *= 1099511628211ULL; }
+    return h;
+}
+
+// Свёртка подходит, если хранит данные с начала периода (или с начала всех данных)
+// с точностью до шага или 5% периода. Из подходящих берём самую грубую, у которой
+// за период не меньше points шагов, иначе самую подробную.
+std::string HttpSimple::auto_kind(std::int64_t from, std::int64_t to, int points) {
+    const auto& kinds = Repo::kinds();
+    std::vector<std::optional<std::int64_t>> oldest;
+    std::int64_t oldestAll = INT64_MAX;
+    {
+        auto lease = m_pool.acquire();
+        for (const auto& kind : kinds) {
+            oldest.push_back(lease->min_ts(kind));
+            if (oldest.back()) oldestAll = std::min(oldestAll, *oldest.back());
+        }
+    }
+    std::int64_t need = std::max(from, oldestAll);
+    std::int64_t slack = std::max<std::int64_t>((to - from) / 20, 0);
+
+    std::string finest = "raw";
+    for (std::size_t i = kinds.size(); i-- > 0;) {
+        std::int64_t step = Repo::step_sec(kinds[i]);
+        if (!oldest[i] || *oldest[i] > need + std::max(step, slack)) continue;
+        if (step == 0 || (to - from) / step >= points) return kinds[i];
+        finest = kinds[i];
+    }
+    return finest;
+}
+
+// raw: индекс блоков -> окно в памяти -> хранилище
+DbStats HttpSimple::raw_stats(std::int64_t from, std::int64_t to) {
+    auto direct = [&](std::int64_t f, std::int64_t t) -> DbStats {
+        if (m_hot) {
+            if (auto s = m_hot->stats(f, t)) return *s;
+        }
+        return m_pool.acquire()->stats("raw", f, t);
+    };
+
+    if (m_index) {
+        if (auto s = m_index->stats(from, to, direct)) return *s;
+    }
+    return direct(from, to);
+}
+
+// raw - из окна в памяти, если оно покрывает период; свёртки - слияние скетчей в бд
+TDigest HttpSimple::sketch(const std::string& kind, std::int64_t from, std::int64_t to) {
+    if (kind == "raw" && m_hot) {
+        TDigest d;
+        if (m_hot->for_each(from, to, [&](const DbPoint& p) { d.add(p.value); return true; })) return d;
+    }
+    return m_pool.acquire()->sketch(kind, from, to);
+}
+
+// "0.5,0.95,0.99" -> список как есть (он же ключи в ответе); каждое число в [0, 1]
+static std::vector<std::string> parse_quantiles(const std::string& s) {
+    std::vector<std::string> out;
+    std::size_t pos = 0;
+    while (pos <= s.size()) {
+        auto comma = s.find(',', pos);
+        if (comma == std::string::npos) comma = s.size();
+        std::string q = s.substr(pos, comma - pos);
+
+        std::size_t used = 0;
+        double v = std::stod(q, &used);
+        if (used != q.size() || !(v >= 0.0 && v <= 1.0)) throw std::runtime_error("bad quantile");
+        out.push_back(q);
+        pos = comma + 1;
+    }
+    if (out.size() > 32) throw std::runtime_error("too many quantiles");
+    return out;
+}
+
+// Медленный клиент не держит снимок чтения: иначе WAL не усечь, пока ответ не ушёл.
+// Следующая страница - с ts последней точки; точки с этим ts, которые уже
+// отданы, пропускаются (у raw ts может повторяться)
+void HttpSimple::for_each_paged(const std::string& kind, std::int64_t from, std::int64_t to, int limit,
+                                const std::function<bool(const DbPoint&)>& fn) {
+    constexpr int page = 4096;
+    std::vector<DbPoint> buf;
+    int skip = 0;
+
+    while (limit != 0) {
+        int want = limit > 0 ? std::min(limit, page) : page;
+        buf.clear();
+        {
+            auto repo = m_pool.acquire();
+            int seen = 0;
+            repo->for_each(kind, from, to, [&](const DbPoint& p) {
+                if (seen++ < skip) return true;
+                buf.push_back(p);
+                return true;
+            }, want + skip);
+        }
+
+        for (const auto& p : buf) {
+            if (!fn(p)) return;
+        }
+        if ((int)buf.size() < want) return;
+        if (limit > 0) limit -= want;
+
+        std::int64_t last = buf.back().ts;
+        int same = 0;
+        for (auto it = buf.rbegin(); it != buf.rend() && it->ts == last; ++it) ++same;
+        skip = last == from ? skip + same : same;
+        from = last;
+    }
+}
+
+// Ряд из хранилища кусками по ~16 КиБ
+bool HttpSimple::stream_series(const std::string& kind, std::int64_t from, std::int64_t to, int limit,
+                               httplib::DataSink& sink) {
+    constexpr std::size_t chunk = 16 * 1024;
+    JsonWriter w(chunk + 256);
+    w.raw("{\"ok\":true,\"points\":[");
+
+    bool alive = true, first = true;
+    try {
+        for_each_paged(kind, from, to, limit, [&](const DbPoint& p) {
+            if (!first) w.raw(",");
+            first = false;
+            write_point(w, p);
+            if (w.size() >= chunk) {
+                alive = sink.write(w.data(), w.size());
+                w.clear();
+            }
+            return alive;
+        });
+    } catch (...) {
+        // заголовки уже ушли, статус не поменять - просто обрываем ответ
+        return false;
+    }
+    if (!alive) return false;
+
+    w.raw("]}");
+    if (!sink.write(w.data(), w.size())) return false;
+    sink.done();
+    return true;
+}
+
+// То же в двоичном виде: отдаём байты потока Gorilla, как только они готовы
+bool HttpSimple::stream_series_bin(const std::string& kind, std::int64_t from, std::int64_t to, int limit,
+                                   httplib::DataSink& sink) {
+    constexpr std::size_t chunk = 16 * 1024;
+    GorillaEncoder enc;
+    if (!sink.write(kBinMagic, sizeof(kBinMagic))) return false;
+
+    bool alive = true;
+    try {
+        for_each_paged(kind, from, to, limit, [&](const DbPoint& p) {
+            enc.append(p.ts, p.value);
+            std::size_t n = enc.full_bytes();
+            if (n >= chunk) {
+                alive = sink.write((const char*)enc.bytes().data(), n);
+                enc.drop_front(n);
+            }
+            return alive;
+        });
+    } catch (...) {
+        return false;
+    }
+    if (!alive) return false;
+
+    std::string tail((const char*)enc.bytes().data(), enc.bytes().size());
+    put_u32_le(tail, (std::uint32_t)enc.count());
+    if (!sink.write(tail.data(), tail.size())) return false;
+    sink.done();
+    return true;
+}
+
+bool HttpSimple::not_modified(const httplib::Request& req, httplib::Response& res,
+                              const std::string& kind, std::int64_t to, const std::string& key) {
+    if (!m_versions) return false;
+
+    // строк новее последней записанной нет: любой to >= неё даёт тот же ответ
+    std::uint64_t gen = m_versions->generation(kind);
+    to = std::min(to, m_versions->last_ts(kind));
+
+    JsonWriter w(64);
+    w.raw("W/\"").u64(m_versions->epoch()).raw("-").u64(gen).raw("-")
+     .u64(hash_str(key + "|" + std::to_string(to))).raw("\"");
+
+    res.set_header("ETag", w.str());
+    res.set_header("Cache-Control", "no-cache");
+
+    auto inm = req.get_header_value("If-None-Match");
+    if (!inm.empty() && inm.find(w.str()) != std::string::npos) {
+        res.status = 304;
+        return true;
+    }
+    return false;
+}
+
 void HttpSimple::run(const std::string& host, int port) {
     httplib::Server svr;
 
+    // каждый SSE-подписчик держит поток пула, поэтому пул больше на их число
+    std::size_t threads = CPPHTTPLIB_THREAD_POOL_COUNT + (m_stream ? m_stream->max_subscribers() : 0);
+    svr.new_task_queue = [threads] { return new httplib::ThreadPool(threads); };
+
     // Текущая температура
-    svr.Get("/api/current", [&](const httplib::Request&, httplib::Response& res) {
-        auto p = m_repo.latest_raw();
+    svr.Get("/api/current", [&](const httplib::Request& req, httplib::Response& res) {
+        if (not_modified(req, res, "raw", INT64_MAX, "current")) return;
+
+        std::optional<DbPoint> p;
+        if (m_hot) p = m_hot->latest();
+        if (!p) p = m_pool.acquire()->latest_raw();
         if (!p) { res.set_content("{\"ok\":false}", "application/json"); return; }
-        std::ostringstream oss;
-        oss << "{\"ok\":true,\"ts\":" << p->ts << ",\"value\":" << p->value << "}";
-        res.set_content(oss.str(), "application/json");
+        auto& w = json_buf();
+        w.raw("{\"ok\":true,\"ts\":").i64(p->ts).raw(",\"value\":").f64(p->value).raw("}");
+        res.set_content(w.data(), w.size(), "application/json");
     });
 
     // Статистика
@@ -35,12 +302,33 @@ void HttpSimple::run(const std::string& host, int port) {
             std::string kind = req.get_param_value("kind");
             auto from = std::stoll(req.get_param_value("from"));
             auto to   = std::stoll(req.get_param_value("to"));
-            auto s = m_repo.stats(kind, from, to);
+            if (!Repo::is_kind(kind)) throw std::runtime_error("wrong kind");
+
+            std::vector<std::string> qs;
+            if (req.has_param("quantiles")) {
+                if (kind != "raw" && !Repo::has_sketch(kind)) throw std::runtime_error("no sketch");
+                qs = parse_quantiles(req.get_param_value("quantiles"));
+            }
+            std::string key = "stats|" + kind + "|" + std::to_string(from);
+            for (const auto& q : qs) key += "|" + q;
+            if (not_modified(req, res, kind, to, key)) return;
 
-            std::ostringstream oss;
-            oss << "{\"ok\":true,\"count\":" << s.count
-                << ",\"min\":" << s.min << ",\"max\":" << s.max << ",\"avg\":" << s.avg << "}";
-            res.set_content(oss.str(), "application/json");
+            auto s = kind == "raw" ? raw_stats(from, to) : m_pool.acquire()->stats(kind, from, to);
+
+            auto& w = json_buf();
+            w.raw("{\"ok\":true,\"count\":").i64(s.count)
+             .raw(",\"min\":").f64(s.min).raw(",\"max\":").f64(s.max).raw(",\"avg\":").f64(s.avg);
+            if (!qs.empty()) {
+                TDigest d = sketch(kind, from, to);
+                w.raw(",\"quantile_count\":").i64((std::int64_t)d.count()).raw(",\"quantiles\":{");
+                for (std::size_t i = 0; i < qs.size(); ++i) {
+                    if (i) w.raw(",");
+                    w.raw("\"").raw(qs[i]).raw("\":").f64(d.quantile(std::stod(qs[i])));
+                }
+                w.raw("}");
+            }
+            w.raw("}");
+            res.set_content(w.data(), w.size(), "application/json");
         } catch (...) {
             res.status = 400;
             res.set_content("{\"ok\":false,\"err\":\"bad request\"}", "application/json");
@@ -49,7 +337,8 @@ void HttpSimple::run(const std::string& host, int port) {
 
 
     svr.Get("/api/series", [&](const httplib::Request& req, httplib::Response& res) {
-        if (!req.has_param("kind") || !req.has_param("from") || !req.has_param("to")) {
+        bool autoRes = req.get_param_value("resolution") == "auto";
+        if ((!autoRes && !req.has_param("kind")) || !req.has_param("from") || !req.has_param("to")) {
             res.status = 400;
             res.set_content("{\"ok\":false,\"err\":\"missing params\"}", "application/json");
             return;
@@ -60,15 +349,162 @@ void HttpSimple::run(const std::string& host, int port) {
             auto to   = std::stoll(req.get_param_value("to"));
             int limit = req.has_param("limit") ? std::stoi(req.get_param_value("limit")) : 1000;
 
-            auto pts = m_repo.series(kind, from, to, limit);
-            std::ostringstream oss;
-            oss << "{\"ok\":true,\"points\":[";
+            int points = req.has_param("points") ? std::stoi(req.get_param_value("points")) : 0;
+            if (points > kMaxPoints) {
+                res.status = 400;
+                res.set_content("{\"ok\":false,\"err\":\"too many points\"}", "application/json");
+                return;
+            }
+            if (autoRes) {
+                if (points <= 0) points = 1000;
+                kind = auto_kind(from, to, points);
+                res.set_header("X-Series-Kind", kind);
+            }
+
+            if (!Repo::is_kind(kind)) throw std::runtime_error("wrong kind");
+            bool bin = wants_bin(req);
+
+            std::string key = "series|" + kind + "|" + std::to_string(from) + "|" + std::to_string(limit) +
+                              (bin ? "|bin" : "|json");
+            if (points > 0) {
+                // ширина корзин считается от настоящего to, прижимать его к последней записи нельзя
+                key += "|" + std::to_string(points) + "|" + req.get_param_value("method") + "|" + std::to_string(to);
+            }
+            if (not_modified(req, res, kind, to, key)) return;
+
+            std::vector<DbPoint> pts;
+            if (points > 0) {
+                DownsampleMethod method = DownsampleMethod::MinMax;
+                if (req.has_param("method") && !parse_downsample_method(req.get_param_value("method"), method))
+                    throw std::runtime_error("bad method");
+
+                Downsampler ds(method, from, to, points);
+                auto push = [&](const DbPoint& p) { ds.push(p); return true; };
+                bool done = m_hot && kind == "raw" && m_hot->for_each(from, to, push);
+                if (!done) m_pool.acquire()->for_each(kind, from, to, push);
+                pts = ds.finish();
+            } else {
+                std::optional<std::vector<DbPoint>> hp;
+                if (m_hot && kind == "raw") hp = m_hot->series(from, to, limit);
+                if (!hp) {
+                    // из хранилища строки идут прямо в chunked-ответ, без вектора и целой строки
+                    if (limit <= 0) limit = 1000;
+                    if (bin) {
+                        res.set_chunked_content_provider("application/octet-stream",
+                            [this, kind, from, to, limit](size_t, httplib::DataSink& sink) {
+                                return stream_series_bin(kind, from, to, limit, sink);
+                            });
+                    } else {
+                        res.set_chunked_content_provider("application/json",
+                            [this, kind, from, to, limit](size_t, httplib::DataSink& sink) {
+                                return stream_series(kind, from, to, limit, sink);
+                            });
+                    }
+                    return;
+                }
+                pts = std::move(*hp);
+            }
+
+            if (bin) {
+                res.set_content(encode_bin(pts), "application/octet-stream");
+                return;
+            }
+
+            auto& w = json_buf();
+            w.raw("{\"ok\":true,");
+            if (autoRes) w.raw("\"kind\":\"").raw(kind).raw("\",");
+            w.raw("\"points\":[");
             for (size_t i = 0; i < pts.size(); ++i) {
-                if (i) oss << ",";
-                oss << "{\"ts\":" << pts[i].ts << ",\"value\":" << pts[i].value << "}";
+                if (i) w.raw(",");
+                write_point(w, pts[i]);
+            }
+            w.raw("]}");
+            res.set_content(w.data(), w.size(), "application/json");
+        } catch (...) {
+            res.status = 400;
+            res.set_content("{\"ok\":false,\"err\":\"bad request\"}", "application/json");
+        }
+    });
+
+    // Live-поток
+    svr.Get("/api/stream", [&](const httplib::Request&, httplib::Response& res) {
+        auto sub = m_stream ? m_stream->subscribe() : nullptr;
+        if (!sub) {
+            res.status = 503;
+            res.set_content("{\"ok\":false,\"err\":\"stream unavailable\"}", "application/json");
+            return;
+        }
+        res.set_header("Cache-Control", "no-cache");
+        res.set_chunked_content_provider("text/event-stream",
+            [sub](size_t, httplib::DataSink& sink) {
+                std::vector<StreamSubscriber::Chunk> chunks;
+                if (!sub->wait(chunks, std::chrono::seconds(15))) return false;
+                // комментарий-пинг: заодно узнаём, что клиент ушёл
+                if (chunks.empty()) return sink.write(": ping\n\n", 8);
+                for (auto& c : chunks) {
+                    if (!sink.write(c->data(), c->size())) return false;
+                }
+                return true;
+            },
+            [this, sub](bool) { m_stream->unsubscribe(sub); });
+    });
+
+    // Очередь приёма
+    svr.Get("/api/ingest", [&](const httplib::Request&, httplib::Response& res) {
+        if (!m_ingest) { res.set_content("{\"ok\":false}", "application/json"); return; }
+        auto& w = json_buf();
+        w.raw("{\"ok\":true,\"depth\":").u64(m_ingest->depth())
+         .raw(",\"capacity\":").u64(m_ingest->capacity())
+         .raw(",\"dropped\":").u64(m_ingest->dropped())
+         .raw(",\"spilled\":").u64(m_ingest->spilled()).raw("}");
+        res.set_content(w.data(), w.size(), "application/json");
+    });
+
+    svr.Get("/api/rolling", [&](const httplib::Request& req, httplib::Response& res) {
+        if (!m_rolling || !req.has_param("window")) {
+            res.status = 400;
+            res.set_content("{\"ok\":false,\"err\":\"missing params\"}", "application/json");
+            return;
+        }
+        try {
+            auto window = std::stoll(req.get_param_value("window"));
+            auto now = timeutil::to_unix(std::chrono::system_clock::now());
+            auto s = m_rolling->stats(window, now);
+            if (!s) {
+                auto& w = json_buf();
+                w.raw("{\"ok\":false,\"err\":\"window not tracked\",\"windows\":[");
+                const auto& all = m_rolling->windows();
+                for (std::size_t i = 0; i < all.size(); ++i) {
+                    if (i) w.raw(",");
+                    w.i64(all[i]);
+                }
+                w.raw("]}");
+                res.status = 404;
+                res.set_content(w.data(), w.size(), "application/json");
+                return;
+            }
+
+            std::string stats = req.has_param("stats") ? req.get_param_value("stats") : "count,avg,min,max";
+            double nan = std::numeric_limits<double>::quiet_NaN();
+
+            auto& w = json_buf();
+            w.raw("{\"ok\":true,\"window\":").i64(window);
+            std::size_t pos = 0;
+            while (pos <= stats.size()) {
+                auto comma = stats.find(',', pos);
+                if (comma == std::string::npos) comma = stats.size();
+                std::string name = stats.substr(pos, comma - pos);
+                pos = comma + 1;
+
+                // у пустого окна avg/min/max нет - null
+                if (name == "count") w.raw(",\"count\":").i64(s->count);
+                else if (name == "avg") w.raw(",\"avg\":").f64(s->count ? s->avg : nan);
+                else if (name == "min") w.raw(",\"min\":").f64(s->count ? s->min : nan);
+                else if (name == "max") w.raw(",\"max\":").f64(s->count ? s->max : nan);
+                else throw std::runtime_error("bad stat");
             }
-            oss << "]}";
-            res.set_content(oss.str(), "application/json");
+            w.raw("}");
+            res.set_content(w.data(), w.size(), "application/json");
         } catch (...) {
             res.status = 400;
             res.set_content("{\"ok\":false,\"err\":\"bad request\"}", "application/json");
@@ -1,12 +1,61 @@
 #pragma once
-#include "sqlite_repo.hpp"
+#include "block_index.hpp"
+#include "broadcaster.hpp"
+#include "data_version.hpp"
+#include "hot_window.hpp"
+#include "ingest_pipeline.hpp"
+#include "rolling_stats.hpp"
+#include "repo.hpp"
+#include <cstdint>
+#include <functional>
 #include <string>
 
+namespace httplib { class DataSink; class Request; class Response; }
+
+// Источники данных в памяти; любого может не быть
+struct HttpSources {
+    const IngestPipeline* ingest = nullptr;   // /api/ingest
+    const HotWindow* hot = nullptr;           // свежие raw-данные
+    const BlockStatsIndex* index = nullptr;   // статистика raw по блокам
+    const DataVersions* versions = nullptr;   // ETag / 304
+    Broadcaster* stream = nullptr;            // /api/stream (SSE)
+    RollingStats* rolling = nullptr;          // /api/rolling
+};
+
 class HttpSimple {
 public:
-    explicit HttpSimple(SqliteRepo& repo) : m_repo(repo) {}
+    // Чтение идёт через пул read-only соединений, писатель их не ждёт
+    explicit HttpSimple(RepoReadPool& pool, HttpSources src = {})
+        : m_pool(pool), m_ingest(src.ingest), m_hot(src.hot), m_index(src.index),
+          m_versions(src.versions), m_stream(src.stream), m_rolling(src.rolling) {}
     void run(const std::string& host, int port);
 
 private:
-    SqliteRepo& m_repo;
+    // Верхняя граница points у series: под неё Downsampler сразу резервирует память
+    static constexpr int kMaxPoints = 10000;
+
+    RepoReadPool& m_pool;
+    const IngestPipeline* m_ingest;
+    const HotWindow* m_hot;
+    const BlockStatsIndex* m_index;
+    const DataVersions* m_versions;
+    Broadcaster* m_stream;
+    RollingStats* m_rolling;
+
+    DbStats raw_stats(std::int64_t from, std::int64_t to);
+    TDigest sketch(const std::string& kind, std::int64_t from, std::int64_t to);
+    // resolution=auto: kind для периода и бюджета точек
+    std::string auto_kind(std::int64_t from, std::int64_t to, int points);
+    // Точки за период страницами: соединение пула (и снимок чтения) берётся
+    // на страницу и отпускается до того, как fn пишет её клиенту
+    void for_each_paged(const std::string& kind, std::int64_t from, std::int64_t to, int limit,
+                        const std::function<bool(const DbPoint&)>& fn);
+    bool stream_series(const std::string& kind, std::int64_t from, std::int64_t to, int limit,
+                       httplib::DataSink& sink);
+    bool stream_series_bin(const std::string& kind, std::int64_t from, std::int64_t to, int limit,
+                           httplib::DataSink& sink);
+
+    // Ставит ETag; true - у клиента актуальная копия, ответ 304 уже готов
+    bool not_modified(const httplib::Request& req, httplib::Response& res,
+                      const std::string& kind, std::int64_t to, const std::string& key);
 };
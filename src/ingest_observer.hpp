@@ -0,0 +1,15 @@
+#pragma once
+#include "repo.hpp"
+
+#include <cstdint>
+#include <string>
+
+// Получатель событий потока записи: пачка закоммичена, старые данные удалены.
+// Так в памяти держатся окна и индексы, согласованные с бд.
+class IngestObserver {
+public:
+    virtual ~IngestObserver() = default;
+    virtual void on_batch(const DbBatch& b) = 0;
+    // Шаг retention закоммичен: строк раньше keep_from уже нет или часть ещё удаляется
+    virtual void on_retention(const std::string& /*kind*/, std::int64_t /*keep_from*/) {}
+};
@@ -0,0 +1,152 @@
+#include "ingest_pipeline.hpp"
+
+#include <iostream>
+#include <thread>
+#include <type_traits>
+
+bool parse_overflow_policy(const std::string& s, OverflowPolicy& out) {
+    if (s == "block") out = OverflowPolicy::Block;
+    else if (s == "drop-oldest") out = OverflowPolicy::DropOldest;
+    else if (s == "spill") out = OverflowPolicy::Spill;
+    else return false;
+    return true;
+}
+
+IngestPipeline::IngestPipeline(Repo& repo, IngestConfig cfg)
+    : m_repo(repo),
+      m_cfg(cfg),
+      m_ring(cfg.queue_cap),
+      m_rollups({"1m", &DbBatch::m1, {}}, {"5m", &DbBatch::m5, {}},
+                {"hourly", &DbBatch::hourly, {}}, {"daily", &DbBatch::daily, {}}) {}
+
+// Итог периода -> строка свёртки; скетч - если агрегатор его копит
+template <class Out>
+static DbRollup to_db(const Out& o) {
+    DbRollup r{timeutil::to_unix(o.period_start), o.count, o.sum, o.min, o.max};
+    if constexpr (std::is_base_of_v<stats::Quantiles, Out>) r.sketch = o.digest.serialize();
+    return r;
+}
+
+void IngestPipeline::resume(timeutil::TP now) {
+    for_each_rollup([&](auto& r) {
+        using Out = typename std::decay_t<decltype(r.agg)>::Out;
+
+        auto open = m_repo.open_period(r.kind);
+        if (!open) {
+            // строка периода уже есть (перенесена миграцией) - новые измерения сольются с ней
+            auto start = timeutil::to_unix(r.agg.floor(now));
+            if (m_repo.stats(r.kind, start, start).count > 0) return;
+
+            auto st = m_repo.stats("raw", start, timeutil::to_unix(now));
+            if (st.count > 0) open = DbRollup{start, st.count, st.avg * (double)st.count, st.min, st.max};
+        }
+        if (!open) return;
+
+        Out o;
+        o.period_start = std::chrono::system_clock::from_time_t((std::time_t)open->ts);
+        o.count = open->count;
+        o.sum = open->sum;
+        o.min = open->min;
+        o.max = open->max;
+        if constexpr (std::is_base_of_v<stats::Quantiles, Out>) {
+            // скетча нет (пересчёт по raw или бд до скетчей) - строим по raw за период
+            if (open->sketch.empty() ||
+                !TDigest::deserialize(open->sketch.data(), open->sketch.size(), o.digest))
+                o.digest = m_repo.sketch("raw", open->ts, timeutil::to_unix(now));
+        }
+        r.agg.resume(o);
+    });
+}
+
+// Положить измерение в очередь согласно политике переполнения
+void IngestPipeline::push(const IngestSample& s) {
+    if (m_cfg.overflow == OverflowPolicy::Spill) {
+        if (m_spill_size.load(std::memory_order_acquire) == 0 && m_ring.try_push(s)) return;
+
+        std::lock_guard<std::mutex> lk(m_spill_mu);
+        if (m_cfg.spill_cap > 0 && m_spill.size() >= m_cfg.spill_cap) {
+            m_spill.pop_front();
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        m_spill.push_back(s);
+        m_spill_size.store(m_spill.size(), std::memory_order_release);
+        m_spilled.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    while (!m_ring.try_push(s)) {
+        if (m_cfg.overflow == OverflowPolicy::DropOldest) {
+            if (m_ring.evict_oldest()) m_dropped.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+    }
+}
+
+// Сначала кольцо, потом spill: всё, что в spill, пришло позже кольца
+bool IngestPipeline::pop(IngestSample& s) {
+    if (m_ring.try_pop(s)) return true;
+    if (m_spill_size.load(std::memory_order_acquire) == 0) return false;
+
+    std::lock_guard<std::mutex> lk(m_spill_mu);
+    if (m_spill.empty()) return false;
+    s = m_spill.front();
+    m_spill.pop_front();
+    m_spill_size.store(m_spill.size(), std::memory_order_release);
+    return true;
+}
+
+void IngestPipeline::run_reader(LineReader& reader, bool (*parse)(const std::string&, double&)) {
+    std::string line;
+    while (reader.readLine(line)) {
+        double temp = 0;
+        if (!parse(line, temp)) continue;
+        push({std::chrono::system_clock::now(), temp});
+    }
+    m_reader_done.store(true, std::memory_order_release);
+}
+
+void IngestPipeline::run_writer() {
+    using steady = std::chrono::steady_clock;
+
+    DbBatch batch;
+    batch.raw.reserve(m_cfg.batch_size);
+
+    auto deadline = steady::time_point::max();
+
+    for (;;) {
+        // читаем флаг до pop: если после него очередь пуста, то пуста навсегда
+        bool done = m_reader_done.load(std::memory_order_acquire);
+
+        IngestSample s;
+        bool got = pop(s);
+        if (got) {
+            if (batch.raw.empty()) deadline = steady::now() + m_cfg.batch_ms;
+
+            batch.raw.push_back({timeutil::to_unix(s.ts), s.value});
+
+            for_each_rollup([&](auto& r) {
+                if (auto fin = r.agg.push(s.ts, s.value)) (batch.*r.out).push_back(to_db(*fin));
+            });
+        }
+
+        bool flush = !batch.empty() &&
+                     (batch.raw.size() >= m_cfg.batch_size || steady::now() >= deadline ||
+                      (!got && done));
+        if (flush) {
+            // состояние незакрытых периодов - в той же транзакции, что и raw
+            for_each_rollup([&](const auto& r) {
+                if (auto cur = r.agg.current()) batch.open.push_back({r.kind, to_db(*cur)});
+            });
+            m_repo.write_batch(batch);
+            for (auto* o : m_observers) o->on_batch(batch);
+            batch.clear();
+            deadline = steady::time_point::max();
+        }
+
+        if (!got) {
+            if (done) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include "agregator.hpp"
+#include "ingest_observer.hpp"
+#include "line_reader.hpp"
+#include "repo.hpp"
+#include "spsc_ring.hpp"
+#include "timeutil.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+// Что делать, когда очередь между чтением и записью заполнена
+enum class OverflowPolicy {
+    Block,       // читатель ждёт, пока писатель освободит место
+    DropOldest,  // выкидываем самое старое измерение из очереди
+    Spill,       // складываем в буфер в памяти (не на диск) до spill_cap, дальше
+                 // выкидываем самое старое из него
+};
+
+bool parse_overflow_policy(const std::string& s, OverflowPolicy& out);
+
+// Измерение; время ставится в момент чтения строки, а не записи в бд
+struct IngestSample {
+    timeutil::TP ts{};
+    double value{};
+};
+
+struct IngestConfig {
+    std::size_t queue_cap = 4096;
+    OverflowPolicy overflow = OverflowPolicy::Block;
+    std::size_t spill_cap = 1 << 20;   // измерений в буфере Spill, ~16 МБ; 0 - без ограничения
+
+    // group commit: пишем, когда набралось batch_size измерений или прошло batch_ms
+    std::size_t batch_size = 256;
+    std::chrono::milliseconds batch_ms{200};
+};
+
+// Конвейер приёма: поток чтения -> очередь -> поток записи в бд.
+// Медленная запись или checkpoint WAL не останавливает чтение порта.
+class IngestPipeline {
+public:
+    IngestPipeline(Repo& repo, IngestConfig cfg);
+
+    // Окна/индексы в памяти, которые получают каждую записанную пачку.
+    // Добавлять до запуска run_writer.
+    void add_observer(IngestObserver* o) { m_observers.push_back(o); }
+
+    // Продолжить незакрытые периоды свёрток после перезапуска: из сохранённого
+    // состояния, а если его нет (бд старой версии) - одним запросом по raw
+    // за текущий период. Вызывать до run_writer.
+    void resume(timeutil::TP now);
+
+    // Стадия чтения: читает и парсит строки, пока вход не закончится
+    void run_reader(LineReader& reader, bool (*parse)(const std::string&, double&));
+
+    // Стадия записи: пачками пишет в бд и считает средние.
+    // Retention и checkpoint - в Maintenance, не здесь.
+    // Выходит, когда чтение закончилось и очередь пуста.
+    void run_writer();
+
+    // Глубина очереди (кольцо + spill)
+    std::size_t depth() const { return m_ring.size() + m_spill_size.load(std::memory_order_relaxed); }
+    std::size_t capacity() const { return m_ring.capacity(); }
+    unsigned long long dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+    unsigned long long spilled() const { return m_spilled.load(std::memory_order_relaxed); }
+
+private:
+    Repo& m_repo;
+    IngestConfig m_cfg;
+    std::vector<IngestObserver*> m_observers;
+
+    SpscRing<IngestSample> m_ring;
+
+    // Spill: пока он не пуст, писатель кладёт только сюда, чтобы не нарушить порядок
+    std::mutex m_spill_mu;
+    std::deque<IngestSample> m_spill;
+    std::atomic<std::size_t> m_spill_size{0};
+
+    std::atomic<bool> m_reader_done{false};
+    std::atomic<unsigned long long> m_dropped{0};
+    std::atomic<unsigned long long> m_spilled{0};
+
+    // свёртки 1m, 5m, hourly, daily; период каждой известен при компиляции.
+    // hourly и daily ещё копят скетч квантилей
+    template <class Period, class... Extra>
+    struct Rollup {
+        const char* kind;
+        std::vector<DbRollup> DbBatch::*out;
+        Aggregator<Period, stats::Sum, stats::Min, stats::Max, Extra...> agg;
+    };
+    std::tuple<Rollup<period::Minute>, Rollup<period::FiveMin>,
+               Rollup<period::Hour, stats::Quantiles>, Rollup<period::Day, stats::Quantiles>> m_rollups;
+
+    template <class Fn>
+    void for_each_rollup(Fn&& fn) {
+        std::apply([&](auto&... r) { (fn(r), ...); }, m_rollups);
+    }
+
+    void push(const IngestSample& s);
+    bool pop(IngestSample& s);
+};
@@ -0,0 +1,48 @@
+#pragma once
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+// JSON в заранее выделенный буфер через std::to_chars:
+// без локали, без ostringstream, буфер переиспользуется после clear().
+class JsonWriter {
+public:
+    explicit JsonWriter(std::size_t reserve = 4096) { m_buf.reserve(reserve); }
+
+    JsonWriter& raw(const char* s) { m_buf.append(s, std::strlen(s)); return *this; }
+    JsonWriter& raw(const std::string& s) { m_buf.append(s); return *this; }
+
+    JsonWriter& i64(std::int64_t v) {
+        char tmp[24];
+        auto r = std::to_chars(tmp, tmp + sizeof(tmp), v);
+        m_buf.append(tmp, r.ptr);
+        return *this;
+    }
+
+    JsonWriter& u64(std::uint64_t v) {
+        char tmp[24];
+        auto r = std::to_chars(tmp, tmp + sizeof(tmp), v);
+        m_buf.append(tmp, r.ptr);
+        return *this;
+    }
+
+    // Кратчайшая запись, которая читается обратно в то же число; nan/inf -> null
+    JsonWriter& f64(double v) {
+        if (!std::isfinite(v)) return raw("null");
+        char tmp[32];
+        auto r = std::to_chars(tmp, tmp + sizeof(tmp), v);
+        m_buf.append(tmp, r.ptr);
+        return *this;
+    }
+
+    void clear() { m_buf.clear(); }
+    std::size_t size() const { return m_buf.size(); }
+    const char* data() const { return m_buf.data(); }
+    const std::string& str() const { return m_buf; }
+
+private:
+    std::string m_buf;
+};
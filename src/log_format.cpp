@@ -0,0 +1,266 @@
+#include "log_format.hpp"
+#include "mapped_file.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+static const char kBinMagic[4] = {'T', 'L', 'B', '1'};
+static constexpr std::uint32_t kBinVersion = 1;
+
+bool parse_log_format(const std::string& s, LogFormat& out) {
+    if (s == "text") out = LogFormat::Text;
+    else if (s == "bin" || s == "binary") out = LogFormat::Binary;
+    else return false;
+    return true;
+}
+
+static void put_le(char* p, std::uint64_t v, int n) {
+    for (int i = 0; i < n; ++i) p[i] = (char)((v >> (8 * i)) & 0xff);
+}
+
+static std::uint64_t get_le(const char* p, int n) {
+    std::uint64_t v = 0;
+    for (int i = 0; i < n; ++i) v |= (std::uint64_t)(unsigned char)p[i] << (8 * i);
+    return v;
+}
+
+static std::int64_t to_ms(const timeutil::TP& tp) {
+    return (std::int64_t)std::chrono::duration_cast<std::chrono::milliseconds>(tp.time_since_epoch()).count();
+}
+
+static timeutil::TP from_ms(std::int64_t ms) {
+    return timeutil::TP(std::chrono::duration_cast<timeutil::TP::duration>(std::chrono::milliseconds(ms)));
+}
+
+std::size_t encode_log_header(LogFormat f, char* buf) {
+    if (f == LogFormat::Text) return 0;
+    std::memcpy(buf, kBinMagic, sizeof(kBinMagic));
+    put_le(buf + 4, kBinVersion, 4);
+    put_le(buf + 8, kBinRecordSize, 4);
+    put_le(buf + 12, crc32(buf, 12), 4);
+    return kBinHeaderSize;
+}
+
+static bool check_bin_header(const char* p, std::size_t n) {
+    if (n < kBinHeaderSize || std::memcmp(p, kBinMagic, sizeof(kBinMagic)) != 0) return false;
+    return get_le(p + 4, 4) == kBinVersion && get_le(p + 8, 4) == kBinRecordSize &&
+           get_le(p + 12, 4) == crc32(p, 12);
+}
+
+// Значение - фиксированная точка с 3 знаками: целые цифры без printf;
+// огромные, nan/inf и спорное округление - через snprintf.
+static std::size_t format_line(char* buf, const LogRecord& r) {
+    timeutil::format_iso_local(r.ts, buf);
+    char* p = buf + timeutil::kIsoLen;
+    *p++ = ' ';
+
+    double v = r.value;
+    double x = v * 1000.0;
+    // около половины последнего знака округление решает точное значение double - как в printf
+    if (std::isfinite(v) && std::fabs(v) < 1e15 && std::fabs(std::fabs(x - std::trunc(x)) - 0.5) > 1e-6) {
+        long long m = std::llround(x);
+        if (m < 0) {
+            *p++ = '-';
+            m = -m;
+        }
+        char tmp[24];
+        int n = 0;
+        long long ip = m / 1000;
+        do { tmp[n++] = (char)('0' + ip % 10); ip /= 10; } while (ip > 0);
+        while (n > 0) *p++ = tmp[--n];
+
+        int frac = (int)(m % 1000);
+        p[0] = '.';
+        p[1] = (char)('0' + frac / 100);
+        p[2] = (char)('0' + frac / 10 % 10);
+        p[3] = (char)('0' + frac % 10);
+        p[4] = '\n';
+        return (std::size_t)(p + 5 - buf);
+    }
+
+    int n = std::snprintf(p, kLogLineMax - (std::size_t)(p - buf), "%.3f\n", v);
+    return n > 0 ? (std::size_t)(p - buf) + (std::size_t)n : 0;
+}
+
+std::size_t encode_log_record(LogFormat f, const LogRecord& r, char* buf) {
+    if (f == LogFormat::Text) return format_line(buf, r);
+
+    std::uint64_t bits;
+    std::memcpy(&bits, &r.value, sizeof(bits));
+    put_le(buf, (std::uint64_t)to_ms(r.ts), 8);
+    put_le(buf + 8, bits, 8);
+    return kBinRecordSize;
+}
+
+// Значение "[-]цифры[.цифры]" без аллокаций и locale. До 15 значащих цифр
+// и 22 знаков после точки результат точный: оба числа - точные double, и
+// одно деление округляется верно. Остальное (экспонента, nan) - strtod.
+static bool parse_value(const char* p, const char* end, double& out) {
+    const char* s = p;
+    bool neg = false;
+    if (s < end && (*s == '-' || *s == '+')) neg = *s++ == '-';
+
+    std::uint64_t m = 0;
+    int digits = 0, frac = 0;
+    bool dot = false;
+    for (; s < end; ++s) {
+        if (*s >= '0' && *s <= '9') {
+            m = m * 10 + (std::uint64_t)(*s - '0');
+            ++digits;
+            if (dot) ++frac;
+        } else if (*s == '.' && !dot) {
+            dot = true;
+        } else {
+            break;
+        }
+    }
+
+    static const double kPow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                     1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+    bool tailOk = s == end || *s == ' ' || *s == '\t';
+    if (digits > 0 && digits <= 15 && frac <= 22 && tailOk) {
+        double v = (double)m / kPow10[frac];
+        out = neg ? -v : v;
+        return true;
+    }
+
+    // строка не оканчивается '\0' - копия на стеке
+    char buf[kLogLineMax];
+    std::size_t n = std::min<std::size_t>((std::size_t)(end - p), sizeof(buf) - 1);
+    std::memcpy(buf, p, n);
+    buf[n] = '\0';
+    char* e = nullptr;
+    out = std::strtod(buf, &e);
+    return e != buf;
+}
+
+// Формат строки: "YYYY-MM-DDTHH:MM:SS value", [s, s + n) без '\n'
+bool parse_log_line(const char* s, std::size_t n, LogRecord& out) {
+    const char* sp = (const char*)std::memchr(s, ' ', n);
+    if (!sp) return false; // неправильная строка
+
+    timeutil::TP tp;
+    if (!timeutil::parse_iso_local(s, (std::size_t)(sp - s), tp)) return false;
+
+    double v;
+    if (!parse_value(sp + 1, s + n, v)) return false;
+
+    out.ts = tp;
+    out.value = v;
+    return true;
+}
+
+bool parse_log_line(const std::string& line, LogRecord& out) {
+    return parse_log_line(line.data(), line.size(), out);
+}
+
+// Строки [b, e) (начало строки ... '\n') с ts >= from в конец out
+template <class Out>
+static void parse_text_chunk(const char* b, const char* e, timeutil::TP from, Out& out) {
+    while (b < e) {
+        const char* nl = (const char*)std::memchr(b, '\n', (std::size_t)(e - b));
+        const char* end = nl ? nl : e;
+        const char* le = (end > b && end[-1] == '\r') ? end - 1 : end;
+
+        LogRecord r;
+        // если строка корректная то добавляем
+        if (parse_log_line(b, (std::size_t)(le - b), r) && r.ts >= from) out.push_back(r);
+        b = end + 1;
+    }
+}
+
+// Меньше этого на поток не делим: запуск потока дороже разбора
+static constexpr std::size_t kMinTextChunk = 1 << 20;
+
+// Текст режется на куски по границам строк, куски разбираются параллельно,
+// результаты склеиваются по порядку. Кэш часа в timeutil у каждого потока свой.
+static void parse_text(const char* data, const char* end, timeutil::TP from, std::deque<LogRecord>& out) {
+    std::size_t size = (std::size_t)(end - data);
+    std::size_t n = std::max(1u, std::thread::hardware_concurrency());
+    n = std::min(n, size / kMinTextChunk);
+    if (n <= 1) {
+        parse_text_chunk(data, end, from, out);
+        return;
+    }
+
+    std::vector<const char*> bounds{data};
+    for (std::size_t i = 1; i < n; ++i) {
+        const char* p = std::max(data + size * i / n, bounds.back());
+        const char* nl = (const char*)std::memchr(p, '\n', (std::size_t)(end - p));
+        bounds.push_back(nl ? nl + 1 : end);
+    }
+    bounds.push_back(end);
+
+    std::vector<std::vector<LogRecord>> parts(n);
+    std::vector<std::thread> workers;
+    auto work = [&](std::size_t i) {
+        // строка лога ~27 байт
+        parts[i].reserve((std::size_t)(bounds[i + 1] - bounds[i]) / 24);
+        parse_text_chunk(bounds[i], bounds[i + 1], from, parts[i]);
+    };
+    for (std::size_t i = 1; i < n; ++i) workers.emplace_back(work, i);
+    work(0);
+    for (auto& t : workers) t.join();
+
+    for (const auto& part : parts) out.insert(out.end(), part.begin(), part.end());
+}
+
+LogFileInfo read_log_file(const std::string& path, timeutil::TP from, std::deque<LogRecord>& out) {
+    LogFileInfo info;
+    MappedFile f(path);
+    if (!f.ok()) return info;
+    info.size = f.size();
+
+    if (f.size() >= sizeof(kBinMagic) && std::memcmp(f.data(), kBinMagic, sizeof(kBinMagic)) == 0) {
+        info.format = LogFormat::Binary;
+        if (!check_bin_header(f.data(), f.size())) return info;
+
+        const char* recs = f.data() + kBinHeaderSize;
+        std::size_t n = (f.size() - kBinHeaderSize) / kBinRecordSize;
+        info.valid_bytes = kBinHeaderSize + n * kBinRecordSize;
+        info.ok = true;
+
+        // Обычно записи идут по времени и первую нужную ищем двоичным поиском.
+        // Но при переводе часов назад запись дописывается в уже начатый сегмент,
+        // тогда файл не по порядку и фильтруем каждую запись
+        std::int64_t fromMs = to_ms(from);
+        auto ts_at = [&](std::size_t i) { return (std::int64_t)get_le(recs + i * kBinRecordSize, 8); };
+        bool sorted = true;
+        for (std::size_t i = 1; i < n && sorted; ++i) sorted = ts_at(i - 1) <= ts_at(i);
+
+        std::size_t lo = 0;
+        if (sorted) {
+            std::size_t hi = n;
+            while (lo < hi) {
+                std::size_t mid = (lo + hi) / 2;
+                if (ts_at(mid) < fromMs) lo = mid + 1;
+                else hi = mid;
+            }
+        }
+        for (std::size_t i = lo; i < n; ++i) {
+            const char* p = recs + i * kBinRecordSize;
+            std::int64_t ms = (std::int64_t)get_le(p, 8);
+            if (ms < fromMs) continue;
+            std::uint64_t bits = get_le(p + 8, 8);
+            LogRecord r;
+            r.ts = from_ms(ms);
+            std::memcpy(&r.value, &bits, sizeof(r.value));
+            out.push_back(r);
+        }
+        return info;
+    }
+
+    // текст: только целые строки, недописанная последняя (без '\n') отбрасывается
+    const char* data = f.data();
+    std::size_t len = f.size();
+    while (len > 0 && data[len - 1] != '\n') --len;
+    info.ok = true;
+    info.valid_bytes = len;
+    if (len > 0) parse_text(data, data + len, from, out);
+    return info;
+}
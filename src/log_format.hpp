@@ -0,0 +1,49 @@
+#pragma once
+#include "timeutil.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+
+struct LogRecord {
+    timeutil::TP ts{};
+    double value{};
+};
+
+// Форматы файлов лога:
+//   text   - строки "YYYY-MM-DDTHH:MM:SS value\n" (локальное время, 3 знака)
+//   binary - заголовок 16 байт + записи по 16 байт, всё little-endian:
+//            "TLB1" | u32 версия | u32 размер записи | u32 CRC32 первых 12 байт
+//            запись: i64 unix-время в мс | f64 value
+// Недописанная при падении последняя запись видна по длине файла.
+enum class LogFormat { Text, Binary };
+
+bool parse_log_format(const std::string& s, LogFormat& out);
+
+constexpr std::size_t kBinHeaderSize = 16;
+constexpr std::size_t kBinRecordSize = 16;
+
+// Буфер под одну запись любого формата: %.3f любого double - до 320 символов
+constexpr std::size_t kLogLineMax = timeutil::kIsoLen + 320;
+
+// Заголовок файла в buf; длина (у текста 0)
+std::size_t encode_log_header(LogFormat f, char* buf);
+// Запись в buf (не меньше kLogLineMax); длина
+std::size_t encode_log_record(LogFormat f, const LogRecord& r, char* buf);
+
+// Строка текстового лога без '\n'
+bool parse_log_line(const char* s, std::size_t n, LogRecord& out);
+bool parse_log_line(const std::string& line, LogRecord& out);
+
+struct LogFileInfo {
+    bool ok = false;             // файл прочитан (у binary - заголовок верный)
+    LogFormat format = LogFormat::Text;
+    std::uint64_t valid_bytes = 0;   // длина без недописанного хвоста
+    std::uint64_t size = 0;
+};
+
+// Записи файла с ts >= from в конец out. Формат - по заголовку.
+// Файл читается через mmap: у binary, если записи по порядку ts, начало ищется
+// двоичным поиском, иначе проверяется каждая; большой text разбирается кусками
+// в нескольких потоках.
+LogFileInfo read_log_file(const std::string& path, timeutil::TP from, std::deque<LogRecord>& out);
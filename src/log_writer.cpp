@@ -0,0 +1,110 @@
+#include "log_writer.hpp"
+
+#include <cstring>
+
+#ifdef _WIN32
+  #include <fcntl.h>
+  #include <io.h>
+  #include <sys/stat.h>
+#else
+  #include <fcntl.h>
+  #include <unistd.h>
+#endif
+
+bool parse_sync_policy(const std::string& s, SyncPolicy& out) {
+    if (s == "flush") out = SyncPolicy::Flush;
+    else if (s == "fdatasync") out = SyncPolicy::Fdatasync;
+    else return false;
+    return true;
+}
+
+LogWriter::LogWriter(LogWriterConfig cfg) : m_cfg(cfg), m_buf(cfg.buffer_bytes ? cfg.buffer_bytes : 1) {}
+
+LogWriter::~LogWriter() {
+    close();
+}
+
+bool LogWriter::open(const std::string& path) {
+    close();
+#ifdef _WIN32
+    m_fd = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_APPEND | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    m_fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+#endif
+    return m_fd >= 0;
+}
+
+void LogWriter::close() {
+    if (m_fd < 0) return;
+    flush();
+#ifdef _WIN32
+    _close(m_fd);
+#else
+    ::close(m_fd);
+#endif
+    m_fd = -1;
+}
+
+// Ошибку записи не повторяем: остаток теряется, логгер работает дальше
+static void write_all(int fd, const char* data, std::size_t n) {
+    std::size_t off = 0;
+    while (off < n) {
+#ifdef _WIN32
+        int w = _write(fd, data + off, (unsigned)(n - off));
+#else
+        ssize_t w = ::write(fd, data + off, n - off);
+#endif
+        if (w <= 0) return;
+        off += (std::size_t)w;
+    }
+}
+
+void LogWriter::write_out() {
+    write_all(m_fd, m_buf.data(), m_len);
+    m_len = 0;
+    m_deadline = steady::time_point::max();
+}
+
+static void datasync(int fd) {
+#ifdef _WIN32
+    _commit(fd);
+#elif defined(__APPLE__)
+    fsync(fd);
+#else
+    fdatasync(fd);
+#endif
+}
+
+void LogWriter::flush() {
+    if (m_fd < 0) return;
+    if (m_len > 0) write_out();
+    if (m_cfg.sync == SyncPolicy::Fdatasync) datasync(m_fd);
+}
+
+void LogWriter::sync() {
+    if (m_fd < 0) return;
+    if (m_len > 0) write_out();
+    datasync(m_fd);
+}
+
+void LogWriter::flush_if_due() {
+    if (m_len > 0 && steady::now() >= m_deadline) flush();
+}
+
+void LogWriter::write(const char* data, std::size_t n) {
+    if (m_fd < 0) return;
+
+    if (m_len + n > m_buf.size()) write_out();
+    if (n > m_buf.size()) {
+        // больше буфера - напрямую
+        write_all(m_fd, data, n);
+    } else {
+        std::memcpy(m_buf.data() + m_len, data, n);
+        m_len += n;
+    }
+
+    if (m_len == 0 || m_cfg.flush_ms < 0) return;
+    auto now = steady::now();
+    if (m_deadline == steady::time_point::max()) m_deadline = now + std::chrono::milliseconds(m_cfg.flush_ms);
+    if (now >= m_deadline) flush();
+}
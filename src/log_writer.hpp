@@ -0,0 +1,58 @@
+#pragma once
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Что делать при сбросе буфера (по заполнению, flush_ms, flush() и закрытию).
+// Буфер уходит в ОС при любой политике, политика решает только про fdatasync
+enum class SyncPolicy {
+    Flush,      // write() в ОС: переживает падение процесса
+    Fdatasync,  // write() + fdatasync(): переживает падение системы
+};
+
+bool parse_sync_policy(const std::string& s, SyncPolicy& out);
+
+struct LogWriterConfig {
+    std::size_t buffer_bytes = 64 * 1024;
+    long long flush_ms = 1000;        // 0 - после каждой записи, < 0 - только по заполнению и flush()
+    SyncPolicy sync = SyncPolicy::Flush;
+};
+
+// Файл, открытый на дозапись на всё время работы, с буфером в памяти.
+// Время проверяется в write() и flush_if_due(); своего таймера нет - если
+// записи могут надолго прекратиться, flush_if_due() вызывает владелец.
+// Ошибки записи, как и раньше у ofstream, не останавливают логгер.
+class LogWriter {
+public:
+    explicit LogWriter(LogWriterConfig cfg = {});
+    ~LogWriter();
+
+    LogWriter(const LogWriter&) = delete;
+    LogWriter& operator=(const LogWriter&) = delete;
+
+    // Закрывает предыдущий файл; false - не открылся
+    bool open(const std::string& path);
+    void close();
+    bool is_open() const { return m_fd >= 0; }
+
+    void write(const char* data, std::size_t n);
+
+    // Буфер -> ОС, и fdatasync, если так велит политика
+    void flush();
+    // flush(), если с первой несброшенной записи прошло flush_ms
+    void flush_if_due();
+    // Буфер -> ОС и fdatasync при любой политике
+    void sync();
+
+private:
+    using steady = std::chrono::steady_clock;
+
+    LogWriterConfig m_cfg;
+    int m_fd = -1;
+    std::vector<char> m_buf;
+    std::size_t m_len = 0;
+    steady::time_point m_deadline = steady::time_point::max();   // когда сбросить буфер
+
+    void write_out();
+};
@@ -0,0 +1,117 @@
+#include "maintenance.hpp"
+
+#include <thread>
+
+// Своё соединение на запись; автоматический checkpoint выключен и здесь
+static SqliteOptions maintenance_options() {
+    SqliteOptions o;
+    o.wal_autocheckpoint = 0;
+    return o;
+}
+
+Maintenance::Maintenance(const std::string& db_path, const IngestPipeline& ingest, MaintenanceConfig cfg)
+    : m_db(std::make_unique<SqliteDb>(db_path, maintenance_options())),
+      m_sqlite(std::make_unique<SqliteRepo>(*m_db)),
+      m_repo(*m_sqlite),
+      m_ingest(ingest),
+      m_cfg(cfg) {
+    m_vacuum = m_db->incremental_vacuum_enabled();
+}
+
+Maintenance::Maintenance(Repo& repo, const IngestPipeline& ingest, MaintenanceConfig cfg)
+    : m_repo(repo), m_ingest(ingest), m_cfg(cfg) {}
+
+void Maintenance::stop() {
+    {
+        std::lock_guard<std::mutex> lk(m_mu);
+        m_stop = true;
+    }
+    m_cv.notify_all();
+}
+
+bool Maintenance::stopping() {
+    std::lock_guard<std::mutex> lk(m_mu);
+    return m_stop;
+}
+
+// Новые границы заменяют недоделанные: они не раньше старых
+void Maintenance::schedule_retention(clock::time_point now) {
+    auto now_unix = timeutil::to_unix(now);
+
+    m_pending.clear();
+    m_pending.push_back({"raw", now_unix - m_cfg.raw_keep_sec});
+    m_pending.push_back({"1m", now_unix - m_cfg.m1_keep_sec});
+    m_pending.push_back({"5m", now_unix - m_cfg.m5_keep_sec});
+    m_pending.push_back({"hourly", now_unix - m_cfg.hour_keep_sec});
+    m_pending.push_back({"daily", timeutil::to_unix(timeutil::start_of_current_year(now))});
+}
+
+// Шаги по retention_chunk строк, пока писателю не понадобилось время.
+// Наблюдатели узнают о каждом закоммиченном шаге: индекс и ETag не должны
+// покрывать строки, которых уже нет, пока идёт долгое удаление
+void Maintenance::step_retention() {
+    while (!m_pending.empty() && !backlogged() && !stopping()) {
+        const Pending p = m_pending.front();
+        bool more = m_repo.retention_step(p.kind, p.keep_from, m_cfg.retention_chunk);
+        for (auto* o : m_observers) o->on_retention(p.kind, p.keep_from);
+        if (more) {
+            // окно между транзакциями, чтобы писатель взял блокировку
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+
+        m_pending.erase(m_pending.begin());
+        m_vacuum_due = m_vacuum;
+    }
+}
+
+void Maintenance::step_vacuum() {
+    while (m_vacuum_due && !backlogged() && !stopping()) {
+        if (m_db->freelist_count() == 0) {
+            m_vacuum_due = false;
+            break;
+        }
+        m_db->incremental_vacuum(m_cfg.vacuum_pages);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+void Maintenance::run() {
+    auto now = clock::now();
+    auto nextRetention  = now + std::chrono::seconds(m_cfg.compact_sec);
+    auto nextCheckpoint = now + std::chrono::seconds(m_cfg.checkpoint_sec);
+    auto nextTruncate   = now + std::chrono::seconds(m_cfg.truncate_sec);
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lk(m_mu);
+            m_cv.wait_for(lk, std::chrono::milliseconds(200), [&] { return m_stop; });
+            if (m_stop) break;
+        }
+        // писатель не успевает - ничего не делаем, догонит и продолжим
+        if (backlogged()) continue;
+
+        now = clock::now();
+        if (now >= nextRetention) {
+            schedule_retention(now);
+            nextRetention = now + std::chrono::seconds(m_cfg.compact_sec);
+        }
+        step_retention();
+        if (m_pending.empty()) step_vacuum();
+
+        if (now >= nextCheckpoint && !backlogged()) {
+            if (m_db) m_db->checkpoint(SQLITE_CHECKPOINT_PASSIVE);
+            else m_repo.sync();
+            nextCheckpoint = now + std::chrono::seconds(m_cfg.checkpoint_sec);
+        }
+        // TRUNCATE обрезает файл WAL; пробуем только при пустой очереди, занято - позже
+        if (m_db && now >= nextTruncate && m_ingest.depth() == 0) {
+            if (!m_db->checkpoint(SQLITE_CHECKPOINT_TRUNCATE).busy)
+                nextTruncate = now + std::chrono::seconds(m_cfg.truncate_sec);
+        }
+    }
+
+    // писатель уже остановлен: переносим WAL в бд целиком
+    if (m_db) m_db->checkpoint(SQLITE_CHECKPOINT_TRUNCATE);
+    else m_repo.sync();
+}
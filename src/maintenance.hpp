@@ -0,0 +1,81 @@
+#pragma once
+#include "ingest_observer.hpp"
+#include "ingest_pipeline.hpp"
+#include "repo.hpp"
+#include "sqlite_db.hpp"
+#include "sqlite_repo.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct MaintenanceConfig {
+    long long raw_keep_sec  = 24 * 3600;
+    long long m1_keep_sec   = 7 * 24 * 3600;
+    long long m5_keep_sec   = 90 * 24 * 3600;
+    long long hour_keep_sec = 30 * 24 * 3600;
+    long long compact_sec   = 300;          // как часто запускать retention
+
+    int retention_chunk = 5000;             // строк за один DELETE
+    long long checkpoint_sec = 10;          // PASSIVE checkpoint WAL (tsdb - fdatasync)
+    long long truncate_sec = 600;           // TRUNCATE checkpoint, когда очередь пуста
+    int vacuum_pages = 256;                 // страниц за один incremental_vacuum
+
+    // очередь приёма глубже этого - обслуживание уступает писателю
+    std::size_t backlog = 256;
+};
+
+// Фоновое обслуживание бд в своём потоке и на своём соединении:
+// retention маленькими шагами, checkpoint WAL, incremental_vacuum.
+// Писатель открывает бд с wal_autocheckpoint=0, поэтому checkpoint
+// не выполняется внутри его коммита.
+// У хранилища без WAL (tsdb) - только retention и раз в checkpoint_sec repo.sync().
+class Maintenance {
+public:
+    // sqlite: своё соединение с бд db_path
+    Maintenance(const std::string& db_path, const IngestPipeline& ingest, MaintenanceConfig cfg);
+    // другое хранилище: repo общий с писателем и сам разбирается с потоками
+    Maintenance(Repo& repo, const IngestPipeline& ingest, MaintenanceConfig cfg);
+
+    // Получают on_retention после каждого шага retention kind. Добавлять до run.
+    void add_observer(IngestObserver* o) { m_observers.push_back(o); }
+
+    // Цикл обслуживания, выходит после stop()
+    void run();
+    void stop();
+
+private:
+    using clock = std::chrono::system_clock;
+
+    struct Pending {
+        const char* kind;
+        std::int64_t keep_from;
+    };
+
+    std::unique_ptr<SqliteDb> m_db;        // только у sqlite
+    std::unique_ptr<SqliteRepo> m_sqlite;
+    Repo& m_repo;
+    const IngestPipeline& m_ingest;
+    MaintenanceConfig m_cfg;
+    std::vector<IngestObserver*> m_observers;
+
+    std::mutex m_mu;
+    std::condition_variable m_cv;
+    bool m_stop = false;
+
+    std::vector<Pending> m_pending;   // незаконченная retention, по порядку
+    bool m_vacuum = false;            // auto_vacuum=INCREMENTAL
+    bool m_vacuum_due = false;        // после retention есть что вернуть ОС
+
+    bool stopping();
+    bool backlogged() const { return m_ingest.depth() >= m_cfg.backlog; }
+
+    void schedule_retention(clock::time_point now);
+    void step_retention();
+    void step_vacuum();
+};
@@ -0,0 +1,65 @@
+#include "mapped_file.hpp"
+#include <cstdint>
+
+#ifdef _WIN32
+  #include <fstream>
+  #include <iterator>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& path) {
+#ifdef _WIN32
+    std::ifstream in(path, std::ios::binary);
+    if (!in) return;
+    m_buf.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    m_data = m_buf.data();
+    m_size = m_buf.size();
+    m_ok = true;
+#else
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    struct stat st{};
+    if (fstat(fd, &st) == 0) {
+        m_size = (std::size_t)st.st_size;
+        m_ok = true;
+        if (m_size > 0) {
+            void* p = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                m_ok = false;
+            } else {
+                m_map = p;
+                m_data = (const char*)p;
+                madvise(p, m_size, MADV_SEQUENTIAL);
+            }
+        }
+    }
+    ::close(fd);
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifndef _WIN32
+    if (m_map) munmap(m_map, m_size);
+#endif
+}
+
+// По таблице на 256 значений
+std::uint32_t crc32(const char* p, std::size_t n) {
+    static const auto table = [] {
+        struct T { std::uint32_t v[256]; } t{};
+        for (std::uint32_t i = 0; i < 256; ++i) {
+            std::uint32_t c = i;
+            for (int k = 0; k < 8; ++k) c = (c >> 1) ^ (0xedb88320u & (0u - (c & 1u)));
+            t.v[i] = c;
+        }
+        return t;
+    }();
+
+    std::uint32_t c = 0xffffffffu;
+    for (std::size_t i = 0; i < n; ++i) c = table.v[(c ^ (unsigned char)p[i]) & 0xff] ^ (c >> 8);
+    return ~c;
+}
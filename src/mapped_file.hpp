@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Файл целиком в памяти только для чтения: mmap, на Windows - чтение в буфер.
+// Размер - на момент открытия; дописанное позже не видно, нужен новый MappedFile
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool ok() const { return m_ok; }
+    const char* data() const { return m_data; }
+    std::size_t size() const { return m_size; }
+
+private:
+    bool m_ok = false;
+    const char* m_data = nullptr;
+    std::size_t m_size = 0;
+#ifdef _WIN32
+    std::vector<char> m_buf;
+#else
+    void* m_map = nullptr;
+#endif
+};
+
+// CRC32 (IEEE)
+std::uint32_t crc32(const char* p, std::size_t n);
@@ -0,0 +1,115 @@
+#include "record_chain.hpp"
+#include <algorithm>
+
+static std::int64_t to_ms(const timeutil::TP& tp) {
+    return (std::int64_t)std::chrono::duration_cast<std::chrono::milliseconds>(tp.time_since_epoch()).count();
+}
+
+static timeutil::TP from_ms(std::int64_t ms) {
+    return timeutil::TP(std::chrono::duration_cast<timeutil::TP::duration>(std::chrono::milliseconds(ms)));
+}
+
+void RecordChain::decode(const Block& b, std::vector<std::pair<std::int64_t, double>>& out) {
+    const auto& bytes = b.enc.bytes();
+    GorillaDecoder dec(bytes.data(), bytes.size(), b.enc.count());
+    std::int64_t ms;
+    double v;
+    while (dec.next(ms, v)) out.push_back({ms, b.scaled ? v / 1000.0 : v});
+}
+
+void RecordChain::add(Block& b, std::int64_t ms, double v) {
+    double s = 0;
+    if (b.scaled && !gorilla_to_milli(v, s)) {
+        // значение не в тысячных: блок дальше хранит double как есть
+        std::vector<std::pair<std::int64_t, double>> pts;
+        pts.reserve(b.enc.count());
+        decode(b, pts);
+        b.enc.clear();
+        b.scaled = false;
+        for (const auto& p : pts) b.enc.append(p.first, p.second);
+    }
+
+    if (b.enc.count() == 0) {
+        b.min_ms = b.max_ms = ms;
+    } else {
+        b.min_ms = std::min(b.min_ms, ms);
+        b.max_ms = std::max(b.max_ms, ms);
+    }
+    b.enc.append(ms, b.scaled ? s : v);
+}
+
+void RecordChain::push_back(const LogRecord& r) {
+    if (m_blocks.empty() || m_blocks.back().enc.count() >= kBlockRecords) {
+        // закрытый блок больше не растёт - запас вектора не нужен
+        if (!m_blocks.empty()) m_blocks.back().enc.shrink_to_fit();
+        m_blocks.emplace_back();
+    }
+    add(m_blocks.back(), to_ms(r.ts), r.value);
+    m_size++;
+}
+
+void RecordChain::clear() {
+    m_blocks.clear();
+    m_size = 0;
+}
+
+std::size_t RecordChain::memory_bytes() const {
+    std::size_t n = 0;
+    for (const auto& b : m_blocks) n += sizeof(Block) + b.enc.capacity();
+    return n;
+}
+
+bool RecordChain::drop_before(timeutil::TP cut) {
+    bool dropped = false;
+    while (!m_blocks.empty()) {
+        Block& b = m_blocks.front();
+
+        // весь блок раньше cut
+        if (from_ms(b.max_ms) < cut) {
+            m_size -= b.enc.count();
+            m_blocks.pop_front();
+            dropped = true;
+            continue;
+        }
+
+        // начало блока: расжимаем и кодируем заново хвост
+        std::vector<std::pair<std::int64_t, double>> pts;
+        pts.reserve(b.enc.count());
+        decode(b, pts);
+
+        std::size_t i = 0;
+        while (i < pts.size() && from_ms(pts[i].first) < cut) ++i;
+        if (i == 0) break;
+
+        m_size -= i;
+        dropped = true;
+
+        bool open = m_blocks.size() == 1;
+        Block nb;
+        for (std::size_t k = i; k < pts.size(); ++k) add(nb, pts[k].first, pts[k].second);
+        if (!open) nb.enc.shrink_to_fit();
+        b = std::move(nb);
+        break;
+    }
+    return dropped;
+}
+
+void RecordChain::for_each(timeutil::TP from, timeutil::TP to,
+                           const std::function<void(const LogRecord&)>& fn) const {
+    std::int64_t fromMs = to_ms(from), toMs = to_ms(to);
+    for (const auto& b : m_blocks) {
+        if (b.max_ms < fromMs || b.min_ms >= toMs) continue;
+
+        const auto& bytes = b.enc.bytes();
+        GorillaDecoder dec(bytes.data(), bytes.size(), b.enc.count());
+        std::int64_t ms;
+        double v;
+        while (dec.next(ms, v)) {
+            if (ms < fromMs || ms >= toMs) continue;
+            LogRecord r;
+            r.ts = from_ms(ms);
+            r.value = b.scaled ? v / 1000.0 : v;
+            fn(r);
+        }
+    }
+}
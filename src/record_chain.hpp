@@ -0,0 +1,49 @@
+#pragma once
+#include "gorilla.hpp"
+#include "log_format.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// Записи лога в памяти: цепочка сжатых блоков Gorilla (ts в мс,
+// delta-of-delta; value - XOR с предыдущим). Блок закрывается на
+// kBlockRecords записях. Устаревшие блоки выбрасываются целиком,
+// частично устаревший первый блок перекодируется.
+// Значения с датчика и из текстового лога - тысячные, поэтому блок,
+// где все значения точно v = m / 1000, хранит m (gorilla_to_milli).
+// Первое значение не в тысячных перекодирует блок как есть.
+class RecordChain {
+public:
+    static constexpr std::size_t kBlockRecords = 1024;
+
+    void push_back(const LogRecord& r);
+    void clear();
+
+    std::size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    // Память под блоки, байт
+    std::size_t memory_bytes() const;
+
+    // Убирает записи с начала, пока ts < cut; false - ничего не убрано
+    bool drop_before(timeutil::TP cut);
+
+    // Записи с ts в [from, to) по порядку хранения
+    void for_each(timeutil::TP from, timeutil::TP to, const std::function<void(const LogRecord&)>& fn) const;
+
+private:
+    struct Block {
+        std::int64_t min_ms = 0, max_ms = 0;
+        bool scaled = true;      // в потоке value * 1000
+        GorillaEncoder enc;
+    };
+
+    std::deque<Block> m_blocks;
+    std::size_t m_size = 0;
+
+    static void add(Block& b, std::int64_t ms, double v);
+    static void decode(const Block& b, std::vector<std::pair<std::int64_t, double>>& out);
+};
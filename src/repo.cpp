@@ -0,0 +1,60 @@
+#include "repo.hpp"
+#include <stdexcept>
+
+struct KindInfo {
+    const char* name;
+    std::int64_t step_sec;   // период свёртки, 0 - raw
+    bool sketch;             // хранит скетч квантилей
+};
+
+// Скетч квантилей хранят только hourly и daily: квантили за месяц - это ~720 скетчей
+static const KindInfo kKindInfo[Repo::kKindCount] = {
+    {"raw",    0,         false},
+    {"1m",     60,        false},
+    {"5m",     300,       false},
+    {"hourly", 3600,      true},
+    {"daily",  24 * 3600, true},
+};
+
+const std::vector<std::string>& Repo::kinds() {
+    static const std::vector<std::string> all = [] {
+        std::vector<std::string> v;
+        for (const auto& kd : kKindInfo) v.push_back(kd.name);
+        return v;
+    }();
+    return all;
+}
+
+bool Repo::is_kind(const std::string& kind) {
+    for (const auto& kd : kKindInfo) {
+        if (kind == kd.name) return true;
+    }
+    return false;
+}
+
+int Repo::kind_index(const std::string& kind) {
+    for (int k = 0; k < kKindCount; ++k) {
+        if (kind == kKindInfo[k].name) return k;
+    }
+    throw std::runtime_error("wrong kind");
+}
+
+std::int64_t Repo::step_sec(const std::string& kind) {
+    return kKindInfo[kind_index(kind)].step_sec;
+}
+
+bool Repo::has_sketch(const std::string& kind) {
+    return kKindInfo[kind_index(kind)].sketch;
+}
+
+std::vector<DbPoint> Repo::series(const std::string& kind, std::int64_t from, std::int64_t to, int limit) {
+    if (limit <= 0) limit = 1000;
+
+    std::vector<DbPoint> out;
+    for_each(kind, from, to, [&](const DbPoint& p) { out.push_back(p); return true; }, limit);
+    return out;
+}
+
+void Repo::retention(const std::string& kind, std::int64_t keep_from) {
+    while (retention_step(kind, keep_from, -1)) {}
+}
@@ -0,0 +1,144 @@
+#pragma once
+#include "tdigest.hpp"
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Точка измерения
+struct DbPoint {
+    std::int64_t ts;
+    double value;
+};
+
+// Статистика
+struct DbStats {
+    long long count = 0;
+    double min = 0, max = 0, avg = 0;
+};
+
+// Свёртка за закрытый период
+struct DbRollup {
+    std::int64_t ts;     // начало периода
+    long long count;
+    double sum, min, max;
+    std::string sketch{};   // TDigest::serialize(); пусто - скетча нет (1m, 5m, старые строки)
+
+    double avg() const { return count > 0 ? sum / (double)count : 0.0; }
+};
+
+// Пачка записей, которая пишется одной транзакцией
+struct DbBatch {
+    std::vector<DbPoint> raw;
+    std::vector<DbRollup> m1, m5, hourly, daily;
+
+    // Незакрытые периоды свёрток после этой пачки (kind -> накопленное);
+    // пишутся в той же транзакции, что и raw
+    std::vector<std::pair<const char*, DbRollup>> open;
+
+    bool empty() const { return raw.empty() && m1.empty() && m5.empty() && hourly.empty() && daily.empty(); }
+    void clear() { raw.clear(); m1.clear(); m5.clear(); hourly.clear(); daily.clear(); open.clear(); }
+
+    // Свёртки kind ("1m", "5m", "hourly", "daily"), для raw - nullptr
+    const std::vector<DbRollup>* rollups(const std::string& kind) const {
+        if (kind == "1m") return &m1;
+        if (kind == "5m") return &m5;
+        if (kind == "hourly") return &hourly;
+        if (kind == "daily") return &daily;
+        return nullptr;
+    }
+};
+
+// Хранилище измерений и свёрток: SqliteRepo (--storage sqlite) или TsdbRepo (tsdb).
+// kind: raw - измерения, 1m/5m/hourly/daily - свёртки count/sum/min/max,
+// у hourly и daily ещё скетч квантилей. ts - unix-время в секундах.
+class Repo {
+public:
+    virtual ~Repo() = default;
+
+    // Все kind по возрастанию шага
+    static constexpr int kKindCount = 5;
+    static const std::vector<std::string>& kinds();
+    static bool is_kind(const std::string& kind);
+    // Индекс kind в kinds(); чужой kind - исключение
+    static int kind_index(const std::string& kind);
+    // Длина периода свёртки в секундах, для raw 0
+    static std::int64_t step_sec(const std::string& kind);
+    // Свёртка kind хранит скетч квантилей
+    static bool has_sketch(const std::string& kind);
+
+    // Вставка данных. Свёртка за уже записанный период сливается с ним
+    virtual void insert_raw(std::int64_t ts, double v) = 0;
+    virtual void insert_rollup(const std::string& kind, const DbRollup& r) = 0;
+
+    // Пачка raw-измерений одной записью
+    virtual void insert_raw_batch(const std::vector<DbPoint>& pts) = 0;
+
+    // raw + закрытые периоды свёрток + незакрытые периоды одной записью
+    virtual void write_batch(const DbBatch& b) = 0;
+
+    // Незакрытый период свёртки kind на момент последней пачки
+    virtual std::optional<DbRollup> open_period(const std::string& kind) = 0;
+
+    // Последняя запись raw
+    virtual std::optional<DbPoint> latest_raw() = 0;
+
+    // Самый новый/старый ts у <kind>
+    virtual std::optional<std::int64_t> max_ts(const std::string& kind) = 0;
+    virtual std::optional<std::int64_t> min_ts(const std::string& kind) = 0;
+
+    // Статистика по <kind> за период <from> .. <to> включительно.
+    // Для свёрток count - число измерений, avg взвешен по нему
+    virtual DbStats stats(const std::string& kind, std::int64_t from, std::int64_t to) = 0;
+    std::vector<DbPoint> series(const std::string& kind, std::int64_t from, std::int64_t to, int limit);
+
+    // Скетч квантилей за период: raw или свёртка с has_sketch, иначе исключение
+    virtual TDigest sketch(const std::string& kind, std::int64_t from, std::int64_t to) = 0;
+
+    // Точки за период по возрастанию ts (для свёрток value = avg), без промежуточного вектора.
+    // fn возвращает false - обход прекращается; limit < 0 - без ограничения
+    virtual void for_each(const std::string& kind, std::int64_t from, std::int64_t to,
+                          const std::function<bool(const DbPoint&)>& fn, int limit = -1) = 0;
+
+    void retention(const std::string& kind, std::int64_t keep_from);
+
+    // Один ограниченный шаг retention: удалить одну старую партицию (сегмент) или
+    // до max_rows строк (max_rows < 0 - без ограничения).
+    // true - ещё осталось что удалять
+    virtual bool retention_step(const std::string& kind, std::int64_t keep_from, int max_rows) = 0;
+
+    // Записанное - на диск (fdatasync). У sqlite это делает checkpoint обслуживания
+    virtual void sync() {}
+};
+
+// Соединения для чтения из HTTP потоков: у каждого запроса своё на время работы
+class RepoReadPool {
+public:
+    // Соединение, взятое из пула; возвращается в пул в деструкторе
+    class Lease {
+    public:
+        Lease(RepoReadPool& pool, Repo& repo) : m_pool(&pool), m_repo(&repo) {}
+        ~Lease() { if (m_pool) m_pool->release(*m_repo); }
+
+        Lease(Lease&& o) noexcept : m_pool(o.m_pool), m_repo(o.m_repo) { o.m_pool = nullptr; }
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        Repo* operator->() const { return m_repo; }
+        Repo& operator*() const { return *m_repo; }
+
+    private:
+        RepoReadPool* m_pool;
+        Repo* m_repo;
+    };
+
+    virtual ~RepoReadPool() = default;
+
+    // Свободное соединение или новое, если свободных нет
+    virtual Lease acquire() = 0;
+
+protected:
+    virtual void release(Repo& repo) = 0;
+};
@@ -1,95 +1,212 @@
 #include "retention.hpp"
+#include <algorithm>
 #include <filesystem>
 #include <fstream>
-#include <iomanip>
+#include <set>
 
-// Парсит одну строку из лог-файла в структуру LogRecord.
-// Формат строки: "YYYY-MM-DDTHH:MM:SS value"
-static bool parse_line(const std::string& line, LogRecord& out) {
-    auto sp = line.find(' ');
-    if (sp == std::string::npos) return false; // неправильная строка
-
-    auto tsStr = line.substr(0, sp);
-    auto valStr = line.substr(sp + 1);
-
-    timeutil::TP tp;
-    if (!timeutil::parse_iso_local(tsStr, tp)) return false;
-
-    try {
-        out.ts = tp;
-        out.value = std::stod(valStr);
-        return true;
-    } catch (...) {
-        // Если stod не смог распарсить то пропускаем строку
-        return false;
-    }
-}
-
-// Конструктор: path - путь к лог-файлу,
+// Конструктор: path - базовый путь лог-файла,
 // cutoff_fn(now) возвращает минимально допустимую дату.
-RetentionLog::RetentionLog(std::string path, std::function<timeutil::TP(timeutil::TP)> cutoff_fn)
-    : m_path(std::move(path)), m_cutoff(std::move(cutoff_fn)) {}
+RetentionLog::RetentionLog(std::string path, std::function<timeutil::TP(timeutil::TP)> cutoff_fn,
+                           std::int64_t segment_sec, LogWriterConfig out, LogFormat format)
+    : m_path(std::move(path)), m_cutoff(std::move(cutoff_fn)), m_segment(segment_sec > 0 ? segment_sec : 3600),
+      m_format(format), m_out(out) {}
+
+std::int64_t RetentionLog::segment_of(const timeutil::TP& ts) const {
+    std::int64_t t = timeutil::to_unix(ts);
+    std::int64_t q = t / m_segment;
+    if (t % m_segment < 0) --q;
+    return q * m_segment;
+}
 
+// text: <path>.<начало>, binary: <path>.<начало>.bin
+std::string RetentionLog::segment_path(std::int64_t start, LogFormat f) const {
+    return m_path + "." + std::to_string(start) + (f == LogFormat::Binary ? ".bin" : "");
+}
 
-// Загрузка существующего файла в память + обрезка старых записей
+// Загрузка сегментов в память + обрезка старых записей.
+// Записи раньше cutoff не читаются вовсе (у binary - двоичный поиск),
+// сегменты другого формата и старый единый файл переписываются в текущий.
 void RetentionLog::load_and_compact(timeutil::TP now) {
+    namespace fs = std::filesystem;
+
     // очищаем текущие данные в памяти
+    m_out.close();
     m_data.clear();
+    m_segments.clear();
 
-    // читаем файл, если он существует
-    std::ifstream in(m_path);
-    if (in) {
-        std::string line;
-        while (std::getline(in, line)) {
-            LogRecord r{};
-            // если строка корректная то добавляем
-            if (parse_line(line, r)) m_data.push_back(r);
+    auto cut = m_cutoff(now);
+    std::set<std::int64_t> convert;   // сегменты, которые надо переписать в m_format
+
+    // читает файл в tmp; недописанный хвост обрезает, битый binary откладывает в *.bad
+    std::deque<LogRecord> tmp;
+    auto load = [&](const fs::path& file) -> bool {
+        std::error_code ec;
+        tmp.clear();
+        auto info = read_log_file(file.string(), cut, tmp);
+        if (!info.ok) {
+            if (info.size > 0) fs::rename(file, fs::path(file.string() + ".bad"), ec);
+            return false;
         }
+        if (info.valid_bytes < info.size) fs::resize_file(file, info.valid_bytes, ec);
+        return true;
+    };
+    auto by_ts = [](const LogRecord& a, const LogRecord& b) { return a.ts < b.ts; };
+
+    // ищем <path>.<число>[.bin] рядом с path; *.tmp и прочее пропускаем
+    fs::path p(m_path);
+    fs::path dir = p.parent_path().empty() ? fs::path(".") : p.parent_path();
+    const std::string prefix = p.filename().string() + ".";
+
+    std::vector<std::pair<std::int64_t, LogFormat>> files;
+    std::error_code ec;
+    for (fs::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        std::string name = it->path().filename().string();
+        if (name.size() <= prefix.size() || name.compare(0, prefix.size(), prefix) != 0) continue;
+
+        const char* num = name.c_str() + prefix.size();
+        char* numEnd = nullptr;
+        long long start = std::strtoll(num, &numEnd, 10);
+        if (numEnd == num) continue;
+        if (*numEnd == '\0') files.push_back({start, LogFormat::Text});
+        else if (std::string(numEnd) == ".bin") files.push_back({start, LogFormat::Binary});
+    }
+    std::sort(files.begin(), files.end(),
+              [](const auto& a, const auto& b) { return a.first < b.first; });
+
+    // сегменты по порядку, в памяти сразу сжатыми блоками: целиком несжатым
+    // в памяти бывает только один файл
+    for (const auto& f : files) {
+        // целиком устаревший удалится ниже в drop_expired - не читаем
+        bool expired = std::chrono::system_clock::from_time_t((std::time_t)(f.first + m_segment)) <= cut;
+        if (!expired) {
+            if (!load(segment_path(f.first, f.second))) continue;
+            std::stable_sort(tmp.begin(), tmp.end(), by_ts);
+            for (const auto& r : tmp) m_data.push_back(r);
+        }
+        if (m_segments.empty() || m_segments.back() != f.first) m_segments.push_back(f.first);
+        if (f.second != m_format) convert.insert(f.first);
     }
 
-    // вычисляем границу хранения
-    auto cut = m_cutoff(now);
-    // удаляем из начала очереди все записи, которые старее границы
-    while (!m_data.empty() && m_data.front().ts < cut) m_data.pop_front();
+    // старый единый файл раскладываем по сегментам
+    if (fs::is_regular_file(p, ec) && load(p) && !tmp.empty()) {
+        for (const auto& r : tmp) convert.insert(segment_of(r.ts));
+        for (auto seg : convert) {
+            if (!std::binary_search(m_segments.begin(), m_segments.end(), seg))
+                m_segments.insert(std::lower_bound(m_segments.begin(), m_segments.end(), seg), seg);
+        }
+
+        // обрезка идёт с головы - записи должны быть по времени
+        m_data.for_each(timeutil::TP::min(), timeutil::TP::max(), [&](const LogRecord& r) { tmp.push_back(r); });
+        std::stable_sort(tmp.begin(), tmp.end(), by_ts);
+        m_data.clear();
+        for (const auto& r : tmp) m_data.push_back(r);
+    }
+    tmp = {};
+
+    for (auto seg : convert) {
+        rewrite_segment(seg);
+        const LogFormat other = m_format == LogFormat::Text ? LogFormat::Binary : LogFormat::Text;
+        fs::remove(segment_path(seg, other), ec);
+    }
+    fs::remove(p, ec);
 
-    // переписываем файл целиком уже без старых строк
-    rewrite_file();
+    drop_expired(cut);
 }
 
 // Добавление одной записи
 void RetentionLog::append(const LogRecord& r) {
     m_data.push_back(r);
 
-    std::ofstream out(m_path, std::ios::app);
-    out << timeutil::format_iso_local(r.ts) << " "
-        << std::fixed << std::setprecision(3) << r.value << "\n";
+    std::int64_t seg = segment_of(r.ts);
+    if (m_segments.empty() || m_segments.back() < seg) {
+        m_segments.push_back(seg);
+    } else {
+        // время ушло назад (перевели часы): сегмент мог уже быть
+        auto it = std::lower_bound(m_segments.begin(), m_segments.end(), seg);
+        if (it == m_segments.end() || *it != seg) m_segments.insert(it, seg);
+    }
+
+    char buf[kLogLineMax];
+
+    // файл активного сегмента открыт всё время, записи копятся в буфере
+    if (seg != m_out_seg || !m_out.is_open()) {
+        std::error_code ec;
+        auto path = segment_path(seg, m_format);
+        bool fresh = std::filesystem::file_size(path, ec) == 0 || ec;
+        m_out.open(path);
+        m_out_seg = seg;
+        if (fresh) m_out.write(buf, encode_log_header(m_format, buf));
+    }
+    m_out.write(buf, encode_log_record(m_format, r, buf));
+}
+
+void RetentionLog::flush() {
+    m_out.flush();
 }
 
-// Компактация в процессе: удаляем старые записи и переписываем файл.
+void RetentionLog::flush_if_due() {
+    m_out.flush_if_due();
+}
+
+// Сегмент сейчас удалят или заменят: его дескриптор больше не годится
+void RetentionLog::release(std::int64_t start) {
+    if (m_out.is_open() && m_out_seg == start) m_out.close();
+}
+
+// Компактация в процессе: удаляем старые записи и сегменты.
 void RetentionLog::compact_to_disk(timeutil::TP now) {
-    auto cut = m_cutoff(now);
-    while (!m_data.empty() && m_data.front().ts < cut) m_data.pop_front();
-    rewrite_file();
+    drop_expired(m_cutoff(now));
 }
 
-// Перезаписывает файл полностью из m_data.
-// Пишем во временный файл *.tmp, а потом заменяет основной файл.
-void RetentionLog::rewrite_file() {
+// Записи раньше cut уходят из памяти; сегменты, целиком раньше cut,
+// удаляются. Частично устаревший не трогаем: переписывать его на каждой
+// компактации - почти целый сегмент записи, а старое в нём отсекает чтение
+void RetentionLog::drop_expired(timeutil::TP cut) {
     namespace fs = std::filesystem;
 
-    fs::path p(m_path);
+    m_data.drop_before(cut);
+
+    std::error_code ec;
+    while (!m_segments.empty() &&
+           std::chrono::system_clock::from_time_t((std::time_t)(m_segments.front() + m_segment)) <= cut) {
+        release(m_segments.front());
+        fs::remove(segment_path(m_segments.front(), m_format), ec);
+        m_segments.pop_front();
+    }
+}
+
+// Перезаписывает сегмент из m_data; записей нет - сегмент удаляется.
+// Пишем во временный файл *.tmp, а потом заменяем сегмент.
+void RetentionLog::rewrite_segment(std::int64_t start) {
+    namespace fs = std::filesystem;
+
+    release(start);
+
+    fs::path p(segment_path(start, m_format));
     fs::path tmp = p;
     tmp += ".tmp";
 
+    std::size_t written = 0;
     {
-        std::ofstream out(tmp.string(), std::ios::trunc);
-        for (const auto& r : m_data) {
-            out << timeutil::format_iso_local(r.ts) << " "
-                << std::fixed << std::setprecision(3) << r.value << "\n";
-        }
+        std::ofstream out(tmp.string(), std::ios::binary | std::ios::trunc);
+        char buf[kLogLineMax];
+        out.write(buf, (std::streamsize)encode_log_header(m_format, buf));
+        m_data.for_each(std::chrono::system_clock::from_time_t((std::time_t)start),
+                        std::chrono::system_clock::from_time_t((std::time_t)(start + m_segment)),
+                        [&](const LogRecord& r) {
+                            out.write(buf, (std::streamsize)encode_log_record(m_format, r, buf));
+                            written++;
+                        });
     }
 
     std::error_code ec;
+    if (written == 0) {
+        fs::remove(tmp, ec);
+        fs::remove(p, ec);
+        auto it = std::lower_bound(m_segments.begin(), m_segments.end(), start);
+        if (it != m_segments.end() && *it == start) m_segments.erase(it);
+        return;
+    }
 
 #ifdef _WIN32
     // удаляем старый файл
@@ -105,5 +222,3 @@ void RetentionLog::rewrite_file() {
         fs::remove(tmp, ec);
     }
 }
-
-    
\ No newline at end of file
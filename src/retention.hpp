@@ -1,33 +1,56 @@
 #pragma once
+#include "log_format.hpp"
+#include "log_writer.hpp"
+#include "record_chain.hpp"
 #include "timeutil.hpp"
+#include <cstdint>
 #include <deque>
 #include <functional>
 #include <string>
 
-struct LogRecord {
-    timeutil::TP ts{};
-    double value{};
-};
-
-// Лог-файл: хранит записи в памяти + в файле
+// Лог: записи в памяти (сжатыми блоками, см. RecordChain) + в файлах-сегментах.
+// Сегмент - файл <path>.<начало> (text) или <path>.<начало>.bin (binary),
+// начало кратно segment_sec (unix-время).
+// Запись дописывается в сегмент своего времени через LogWriter (файл открыт,
+// буфер сбрасывается по размеру/времени); retention удаляет только сегменты,
+// устаревшие целиком: частично устаревший остаётся как есть, его старые
+// записи отсекаются при чтении по cutoff.
 class RetentionLog {
 public:
     // cutoff_fn(now) -> все записи раньше этого момента удаляем
-    RetentionLog(std::string path, std::function<timeutil::TP(timeutil::TP)> cutoff_fn);
+    RetentionLog(std::string path, std::function<timeutil::TP(timeutil::TP)> cutoff_fn,
+                 std::int64_t segment_sec = 3600, LogWriterConfig out = {},
+                 LogFormat format = LogFormat::Text);
 
-    // Прочитать файл, обрезать по cutoff, переписать файл
+    // Прочитать сегменты (и старый единый файл path), обрезать по cutoff
     void load_and_compact(timeutil::TP now);
 
-    // Добавить запись: append в файл + в память
+    // Добавить запись: append в сегмент + в память
     void append(const LogRecord& r);
 
-    // Обрезать в памяти и переписать файл целиком
+    // Обрезать в памяти, удалить устаревшие сегменты
     void compact_to_disk(timeutil::TP now);
 
+    // Сбросить буфер активного сегмента (и fdatasync по политике)
+    void flush();
+    // То же, если истёк flush_ms: когда вход молчит, append() не вызывается
+    void flush_if_due();
+
 private:
     std::string m_path;
-    std::deque<LogRecord> m_data;
+    RecordChain m_data;                    // записи в памяти, сжатые
     std::function<timeutil::TP(timeutil::TP)> m_cutoff;
+    std::int64_t m_segment;
+    LogFormat m_format;
+
+    std::deque<std::int64_t> m_segments;   // начала сегментов на диске, по возрастанию
+
+    LogWriter m_out;                       // активный сегмент
+    std::int64_t m_out_seg = 0;
 
-    void rewrite_file();
+    std::int64_t segment_of(const timeutil::TP& ts) const;
+    std::string segment_path(std::int64_t start, LogFormat f) const;
+    void drop_expired(timeutil::TP cut);
+    void rewrite_segment(std::int64_t start);
+    void release(std::int64_t start);
 };
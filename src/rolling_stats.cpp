@@ -0,0 +1,88 @@
+#include "rolling_stats.hpp"
+
+#include <algorithm>
+#include <limits>
+
+RollingStats::RollingStats(std::vector<std::int64_t> windows_sec) : m_windows(std::move(windows_sec)) {
+    std::sort(m_windows.begin(), m_windows.end());
+    m_windows.erase(std::unique(m_windows.begin(), m_windows.end()), m_windows.end());
+    for (auto sec : m_windows) {
+        Window w;
+        w.sec = sec;
+        m_win.push_back(std::move(w));
+    }
+}
+
+void RollingStats::push_locked(const DbPoint& p) {
+    std::uint64_t seq = m_base + m_pts.size();
+    m_pts.push_back(p);
+
+    for (auto& w : m_win) {
+        w.count++;
+        w.sum += p.value;
+        // точки, которые уже не станут минимумом/максимумом, выкидываем с хвоста
+        while (!w.minq.empty() && w.minq.back().value >= p.value) w.minq.pop_back();
+        w.minq.push_back({seq, p.value});
+        while (!w.maxq.empty() && w.maxq.back().value <= p.value) w.maxq.pop_back();
+        w.maxq.push_back({seq, p.value});
+    }
+}
+
+// Окно (now - sec, now]: выводим из окон точки с ts <= now - sec
+void RollingStats::advance_locked(std::int64_t now) {
+    std::uint64_t end = m_base + m_pts.size();
+    for (auto& w : m_win) {
+        std::int64_t cut = now - w.sec;
+        while (w.first < end && m_pts[(std::size_t)(w.first - m_base)].ts <= cut) {
+            w.sum -= m_pts[(std::size_t)(w.first - m_base)].value;
+            w.count--;
+            w.first++;
+        }
+        // бегущая сумма без накопленной погрешности, когда окно опустело
+        if (w.count == 0) w.sum = 0.0;
+        while (!w.minq.empty() && w.minq.front().seq < w.first) w.minq.pop_front();
+        while (!w.maxq.empty() && w.maxq.front().seq < w.first) w.maxq.pop_front();
+    }
+
+    // самое длинное окно - последнее, раньше его первой точки ничего не нужно
+    if (m_win.empty()) return;
+    while (m_base < m_win.back().first) {
+        m_pts.pop_front();
+        m_base++;
+    }
+}
+
+void RollingStats::warm(Repo& repo, std::int64_t now) {
+    if (m_windows.empty()) return;
+    std::lock_guard<std::mutex> lk(m_mu);
+    repo.for_each("raw", now - m_windows.back() + 1, std::numeric_limits<std::int64_t>::max(),
+                  [&](const DbPoint& p) { push_locked(p); return true; });
+    advance_locked(now);
+}
+
+void RollingStats::on_batch(const DbBatch& b) {
+    if (b.raw.empty() || m_windows.empty()) return;
+    std::lock_guard<std::mutex> lk(m_mu);
+    for (const auto& p : b.raw) push_locked(p);
+    advance_locked(b.raw.back().ts);
+}
+
+std::optional<DbStats> RollingStats::stats(std::int64_t window_sec, std::int64_t now) {
+    auto it = std::find(m_windows.begin(), m_windows.end(), window_sec);
+    if (it == m_windows.end()) return std::nullopt;
+
+    std::lock_guard<std::mutex> lk(m_mu);
+    // время не идёт назад: последняя точка могла прийти с ts чуть больше now
+    if (!m_pts.empty()) now = std::max(now, m_pts.back().ts);
+    advance_locked(now);
+
+    const auto& w = m_win[(std::size_t)(it - m_windows.begin())];
+    DbStats s{};
+    s.count = w.count;
+    if (w.count > 0) {
+        s.min = w.minq.front().value;
+        s.max = w.maxq.front().value;
+        s.avg = w.sum / (double)w.count;
+    }
+    return s;
+}
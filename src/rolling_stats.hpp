@@ -0,0 +1,56 @@
+#pragma once
+#include "ingest_observer.hpp"
+#include "repo.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+// Скользящая статистика raw за последние N секунд для заранее заданных N.
+// Ведётся по мере записи: сумма и count - бегущие, min/max - монотонные
+// деки (в голове всегда минимум/максимум окна). Ответ - O(1) амортизированно,
+// без запросов к бд.
+//
+// Точки лежат в одной деке на самое длинное окно, окна хранят номер своей
+// первой точки. Пишет поток записи, читают HTTP потоки; чтение тоже сдвигает
+// окна к текущему времени, поэтому под одной блокировкой.
+class RollingStats : public IngestObserver {
+public:
+    explicit RollingStats(std::vector<std::int64_t> windows_sec);
+
+    // Прогрев из raw_measurements при старте
+    void warm(Repo& repo, std::int64_t now);
+
+    void on_batch(const DbBatch& b) override;
+
+    const std::vector<std::int64_t>& windows() const { return m_windows; }
+
+    // Статистика за (now - window, now]; nullopt - такое окно не ведётся
+    std::optional<DbStats> stats(std::int64_t window_sec, std::int64_t now);
+
+private:
+    struct Item {
+        std::uint64_t seq;   // сквозной номер точки
+        double value;
+    };
+    struct Window {
+        std::int64_t sec = 0;
+        std::uint64_t first = 0;       // номер первой точки в окне
+        long long count = 0;
+        double sum = 0.0;
+        std::deque<Item> minq, maxq;   // по возрастанию / убыванию value
+    };
+
+    std::vector<std::int64_t> m_windows;
+
+    std::mutex m_mu;
+    std::deque<DbPoint> m_pts;         // точки самого длинного окна
+    std::uint64_t m_base = 0;          // номер m_pts.front()
+    std::vector<Window> m_win;
+
+    void push_locked(const DbPoint& p);
+    void advance_locked(std::int64_t now);
+};
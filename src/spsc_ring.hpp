@@ -0,0 +1,102 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Ограниченная lock-free очередь: один писатель, один читатель.
+// Ёмкость округляется вверх до степени двойки.
+//
+// Писатель может ещё и выкинуть самую старую запись (evict_oldest) -
+// поэтому голову двигаем через CAS и у читателя. У каждого слота свой номер
+// (seq): pos + 1 - в слоте запись pos, pos + ёмкость - слот свободен для
+// записи pos + ёмкость. Слот сначала забирается CAS головы и только потом
+// читается, а писатель не пишет в слот, пока его не освободили, - так
+// запись и чтение одного слота не пересекаются.
+template <class T>
+class SpscRing {
+public:
+    explicit SpscRing(std::size_t capacity) {
+        std::size_t cap = 1;
+        while (cap < capacity) cap <<= 1;
+        m_slots = std::vector<Slot>(cap);
+        for (std::size_t i = 0; i < cap; ++i) m_slots[i].seq.store(i, std::memory_order_relaxed);
+        m_mask = cap - 1;
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    // Писатель. false - очередь полна
+    bool try_push(const T& v) {
+        auto t = m_tail.load(std::memory_order_relaxed);
+        if (t - m_head.load(std::memory_order_acquire) > m_mask) return false;
+        // голова уже ушла, но читатель ещё копирует слот - это недолго
+        Slot& s = m_slots[t & m_mask];
+        while (s.seq.load(std::memory_order_acquire) != t) std::this_thread::yield();
+        s.value = v;
+        s.seq.store(t + 1, std::memory_order_release);
+        m_tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Писатель. Выкинуть самую старую запись; false - очередь пуста
+    bool evict_oldest() {
+        auto h = m_head.load(std::memory_order_acquire);
+        while (h != m_tail.load(std::memory_order_relaxed)) {
+            if (m_head.compare_exchange_weak(h, h + 1, std::memory_order_acq_rel,
+                                             std::memory_order_acquire)) {
+                release(h);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Читатель. false - очередь пуста
+    bool try_pop(T& out) {
+        auto h = m_head.load(std::memory_order_acquire);
+        for (;;) {
+            if (m_slots[h & m_mask].seq.load(std::memory_order_acquire) != h + 1) {
+                // запись h ещё не готова или её уже выкинули - смотрим, сдвинулась ли голова
+                auto now = m_head.load(std::memory_order_acquire);
+                if (now == h) return false;
+                h = now;
+                continue;
+            }
+            if (m_head.compare_exchange_weak(h, h + 1, std::memory_order_acq_rel,
+                                             std::memory_order_acquire)) {
+                out = m_slots[h & m_mask].value;
+                release(h);
+                return true;
+            }
+        }
+    }
+
+    // Текущее число записей (приблизительно, если обе стороны работают)
+    std::size_t size() const {
+        auto t = m_tail.load(std::memory_order_acquire);
+        auto h = m_head.load(std::memory_order_acquire);
+        return t - h;
+    }
+
+    std::size_t capacity() const { return m_mask + 1; }
+
+private:
+    struct Slot {
+        std::atomic<std::size_t> seq{0};
+        T value{};
+    };
+
+    std::vector<Slot> m_slots;
+    std::size_t m_mask = 0;
+
+    // голова и хвост на разных кэш-линиях, чтобы стороны не мешали друг другу
+    alignas(64) std::atomic<std::size_t> m_head{0};
+    alignas(64) std::atomic<std::size_t> m_tail{0};
+
+    // Слот записи h забран - свободен для записи h + ёмкость
+    void release(std::size_t h) {
+        m_slots[h & m_mask].seq.store(h + m_mask + 1, std::memory_order_release);
+    }
+};
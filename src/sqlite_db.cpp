@@ -1,17 +1,49 @@
 #include "sqlite_db.hpp"
 
+SqliteStmt::~SqliteStmt() {
+    if (m_st) {
+        sqlite3_reset(m_st);
+        sqlite3_clear_bindings(m_st);
+    }
+}
+
 // Открываем бд
-SqliteDb::SqliteDb(const std::string& path) {
-    if (sqlite3_open(path.c_str(), &m_db) != SQLITE_OK) {
+SqliteDb::SqliteDb(const std::string& path, const SqliteOptions& opts) {
+    // соединение используется одним потоком за раз, мьютекс sqlite не нужен
+    int flags = SQLITE_OPEN_NOMUTEX;
+    flags |= opts.read_only ? SQLITE_OPEN_READONLY : (SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+
+    if (sqlite3_open_v2(path.c_str(), &m_db, flags, nullptr) != SQLITE_OK) {
+        if (m_db) sqlite3_close(m_db);
         throw std::runtime_error("sqlite3_open failed");
     }
-    
-    exec("PRAGMA journal_mode=WAL;");
-    exec("PRAGMA synchronous=NORMAL;");
+    sqlite3_busy_timeout(m_db, opts.busy_timeout_ms);
+    m_read_only = opts.read_only;
+    m_busy_ms = opts.busy_timeout_ms;
+
+    if (opts.read_only) {
+        // WAL уже включил писатель; читатель только запрещает себе запись
+        exec("PRAGMA query_only=1;");
+    } else {
+        // page_size и auto_vacuum меняются только до создания первой таблицы
+        if (opts.page_size > 0) exec("PRAGMA page_size=" + std::to_string(opts.page_size) + ";");
+        if (opts.incremental_vacuum) exec("PRAGMA auto_vacuum=INCREMENTAL;");
+        exec("PRAGMA journal_mode=WAL;");
+        exec("PRAGMA synchronous=NORMAL;");
+    }
+
+    if (opts.mmap_size > 0) exec("PRAGMA mmap_size=" + std::to_string(opts.mmap_size) + ";");
+    if (opts.cache_size != 0) exec("PRAGMA cache_size=" + std::to_string(opts.cache_size) + ";");
+    if (opts.temp_store >= 0) exec("PRAGMA temp_store=" + std::to_string(opts.temp_store) + ";");
+    if (opts.wal_autocheckpoint >= 0)
+        exec("PRAGMA wal_autocheckpoint=" + std::to_string(opts.wal_autocheckpoint) + ";");
 }
 
 // Закрываем бд
 SqliteDb::~SqliteDb() {
+    // все подготовленные запросы нужно финализировать до закрытия соединения
+    for (auto& kv : m_stmts) sqlite3_finalize(kv.second);
+    m_stmts.clear();
     if (m_db) sqlite3_close(m_db);
 }
 
@@ -23,3 +55,80 @@ void SqliteDb::exec(const std::string& sql) {
         throw std::runtime_error(msg);
     }
 }
+
+SqliteStmt SqliteDb::prepare(const std::string& sql) {
+    auto it = m_stmts.find(sql);
+    if (it != m_stmts.end()) return SqliteStmt(it->second);
+
+    sqlite3_stmt* st = nullptr;
+    if (sqlite3_prepare_v3(m_db, sql.c_str(), -1, SQLITE_PREPARE_PERSISTENT, &st, nullptr) != SQLITE_OK)
+        throw std::runtime_error(std::string("sqlite prepare failed: ") + sqlite3_errmsg(m_db));
+
+    m_stmts.emplace(sql, st);
+    return SqliteStmt(st);
+}
+
+static bool is_ident_char(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+// name в sql целым идентификатором: forget("raw_p1") не задевает raw_p10
+static bool mentions(const std::string& sql, const std::string& name) {
+    if (name.empty()) return false;
+    for (auto pos = sql.find(name); pos != std::string::npos; pos = sql.find(name, pos + 1)) {
+        std::size_t end = pos + name.size();
+        if ((pos == 0 || !is_ident_char(sql[pos - 1])) && (end == sql.size() || !is_ident_char(sql[end])))
+            return true;
+    }
+    return false;
+}
+
+void SqliteDb::forget(const std::string& name) {
+    for (auto it = m_stmts.begin(); it != m_stmts.end();) {
+        if (mentions(it->first, name)) {
+            sqlite3_finalize(it->second);
+            it = m_stmts.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void SqliteDb::step_done(const std::string& sql) {
+    auto st = prepare(sql);
+    if (sqlite3_step(st) != SQLITE_DONE)
+        throw std::runtime_error(std::string("sqlite step failed: ") + sqlite3_errmsg(m_db));
+}
+
+// IMMEDIATE: сразу берём блокировку на запись, чтобы не ловить BUSY при апгрейде
+void SqliteDb::begin()    { step_done("BEGIN IMMEDIATE"); }
+void SqliteDb::begin_read() { step_done("BEGIN"); }
+void SqliteDb::commit()   { step_done("COMMIT"); }
+void SqliteDb::rollback() { step_done("ROLLBACK"); }
+
+SqliteCheckpoint SqliteDb::checkpoint(int mode) {
+    SqliteCheckpoint r;
+    if (mode != SQLITE_CHECKPOINT_PASSIVE) sqlite3_busy_timeout(m_db, 0);
+    int rc = sqlite3_wal_checkpoint_v2(m_db, nullptr, mode, &r.log, &r.done);
+    if (mode != SQLITE_CHECKPOINT_PASSIVE) sqlite3_busy_timeout(m_db, m_busy_ms);
+
+    if (rc == SQLITE_BUSY) r.busy = true;
+    else if (rc != SQLITE_OK) throw std::runtime_error(std::string("sqlite checkpoint failed: ") + sqlite3_errmsg(m_db));
+    else r.busy = r.done < r.log;
+    return r;
+}
+
+bool SqliteDb::incremental_vacuum_enabled() {
+    auto st = prepare("PRAGMA auto_vacuum");
+    return sqlite3_step(st) == SQLITE_ROW && sqlite3_column_int(st, 0) == 2;
+}
+
+long long SqliteDb::freelist_count() {
+    auto st = prepare("PRAGMA freelist_count");
+    if (sqlite3_step(st) != SQLITE_ROW) return 0;
+    return (long long)sqlite3_column_int64(st, 0);
+}
+
+void SqliteDb::incremental_vacuum(int pages) {
+    exec("PRAGMA incremental_vacuum(" + std::to_string(pages) + ");");
+}
@@ -1,20 +1,109 @@
 #pragma once
 #include <string>
 #include <stdexcept>
+#include <unordered_map>
 #include <sqlite3.h>
 
+// Подготовленный запрос из кэша соединения.
+// При выходе из области видимости сбрасывается (reset + clear bindings),
+// сам запрос остаётся в кэше и переиспользуется.
+class SqliteStmt {
+public:
+    explicit SqliteStmt(sqlite3_stmt* st) : m_st(st) {}
+    ~SqliteStmt();
+
+    SqliteStmt(SqliteStmt&& o) noexcept : m_st(o.m_st) { o.m_st = nullptr; }
+    SqliteStmt(const SqliteStmt&) = delete;
+    SqliteStmt& operator=(const SqliteStmt&) = delete;
+
+    sqlite3_stmt* get() const { return m_st; }
+    operator sqlite3_stmt*() const { return m_st; }
+
+private:
+    sqlite3_stmt* m_st = nullptr;
+};
+
+// Параметры соединения
+struct SqliteOptions {
+    bool read_only = false;      // SQLITE_OPEN_READONLY + PRAGMA query_only
+    long long mmap_size = 0;     // PRAGMA mmap_size в байтах, 0 - по умолчанию
+    int cache_size = 0;          // PRAGMA cache_size (<0 - в КиБ), 0 - по умолчанию
+    int page_size = 0;           // PRAGMA page_size (только для новой бд), 0 - по умолчанию
+    int temp_store = -1;         // PRAGMA temp_store: 0 default, 1 file, 2 memory; -1 - не трогать
+    int busy_timeout_ms = 5000;  // сколько ждать чужую блокировку
+    int wal_autocheckpoint = -1; // PRAGMA wal_autocheckpoint, -1 - по умолчанию, 0 - выключен
+    bool incremental_vacuum = false; // PRAGMA auto_vacuum=INCREMENTAL (только для новой бд)
+};
+
+// Результат sqlite3_wal_checkpoint_v2
+struct SqliteCheckpoint {
+    bool busy = false;   // не всё перенесено: мешают читатели или писатель
+    int log = 0;         // кадров в WAL
+    int done = 0;        // из них перенесено в бд
+};
+
 class SqliteDb {
 public:
-    explicit SqliteDb(const std::string& path);
+    explicit SqliteDb(const std::string& path, const SqliteOptions& opts = {});
     ~SqliteDb();
 
     SqliteDb(const SqliteDb&) = delete;
     SqliteDb& operator=(const SqliteDb&) = delete;
 
     sqlite3* handle() const { return m_db; }
+    bool read_only() const { return m_read_only; }
 
     void exec(const std::string& sql);
 
+    // Запрос готовится один раз на соединение, дальше берётся из кэша
+    SqliteStmt prepare(const std::string& sql);
+
+    // Выкинуть из кэша запросы, где name встречается целым идентификатором
+    // (например, удалённая таблица)
+    void forget(const std::string& name);
+
+    // Транзакции (BEGIN IMMEDIATE / COMMIT / ROLLBACK), begin_read - BEGIN DEFERRED
+    void begin();
+    void begin_read();
+    void commit();
+    void rollback();
+
+    // Checkpoint WAL (SQLITE_CHECKPOINT_*). Кроме PASSIVE - без ожидания блокировок,
+    // чтобы не задерживать писателя: занято - вернёт busy.
+    SqliteCheckpoint checkpoint(int mode);
+
+    // PRAGMA auto_vacuum == INCREMENTAL
+    bool incremental_vacuum_enabled();
+    // Свободных страниц в файле
+    long long freelist_count();
+    // Вернуть ОС до pages свободных страниц
+    void incremental_vacuum(int pages);
+
 private:
     sqlite3* m_db = nullptr;
+    bool m_read_only = false;
+    int m_busy_ms = 0;
+    std::unordered_map<std::string, sqlite3_stmt*> m_stmts;
+
+    void step_done(const std::string& sql);
+};
+
+// Транзакция на время области видимости: без commit() откатывается
+class SqliteTx {
+public:
+    explicit SqliteTx(SqliteDb& db) : m_db(db) { m_db.begin(); }
+    ~SqliteTx() {
+        if (!m_done) {
+            try { m_db.rollback(); } catch (...) {}
+        }
+    }
+
+    SqliteTx(const SqliteTx&) = delete;
+    SqliteTx& operator=(const SqliteTx&) = delete;
+
+    void commit() { m_db.commit(); m_done = true; }
+
+private:
+    SqliteDb& m_db;
+    bool m_done = false;
 };
@@ -0,0 +1,32 @@
+#include "sqlite_pool.hpp"
+
+SqliteReadPool::SqliteReadPool(std::string path, SqliteOptions opts)
+    : m_path(std::move(path)), m_opts(opts) {
+    m_opts.read_only = true;
+}
+
+SqliteReadPool::Lease SqliteReadPool::acquire() {
+    std::unique_ptr<Conn> c;
+    {
+        std::lock_guard<std::mutex> lk(m_mu);
+        if (!m_idle.empty()) {
+            c = std::move(m_idle.back());
+            m_idle.pop_back();
+        }
+    }
+    // открываем вне блокировки: это медленно
+    if (!c) c = std::make_unique<Conn>(m_path, m_opts);
+
+    Repo& repo = c->repo;
+    std::lock_guard<std::mutex> lk(m_mu);
+    m_busy.emplace(&repo, std::move(c));
+    return Lease(*this, repo);
+}
+
+void SqliteReadPool::release(Repo& repo) {
+    std::lock_guard<std::mutex> lk(m_mu);
+    auto it = m_busy.find(&repo);
+    if (it == m_busy.end()) return;
+    m_idle.push_back(std::move(it->second));
+    m_busy.erase(it);
+}
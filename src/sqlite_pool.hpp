@@ -0,0 +1,40 @@
+#pragma once
+#include "repo.hpp"
+#include "sqlite_db.hpp"
+#include "sqlite_repo.hpp"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Пул read-only соединений для HTTP потоков.
+// В режиме WAL читатели не блокируют писателя и друг друга,
+// поэтому каждому потоку - своё соединение со своим кэшем запросов.
+class SqliteReadPool : public RepoReadPool {
+    struct Conn {
+        SqliteDb db;
+        SqliteRepo repo;
+        Conn(const std::string& path, const SqliteOptions& opts) : db(path, opts), repo(db) {}
+    };
+
+public:
+    SqliteReadPool(std::string path, SqliteOptions opts);
+
+    SqliteReadPool(const SqliteReadPool&) = delete;
+    SqliteReadPool& operator=(const SqliteReadPool&) = delete;
+
+    Lease acquire() override;
+
+protected:
+    void release(Repo& repo) override;
+
+private:
+    std::string m_path;
+    SqliteOptions m_opts;
+
+    std::mutex m_mu;
+    std::vector<std::unique_ptr<Conn>> m_idle;
+    std::map<Repo*, std::unique_ptr<Conn>> m_busy;   // выданные, по их repo
+};
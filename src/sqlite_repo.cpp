@@ -1,4 +1,5 @@
 #include "sqlite_repo.hpp"
+#include <algorithm>
 #include <stdexcept>
 
 static void bind_i64(sqlite3_stmt* st, int idx, std::int64_t v) {
@@ -11,132 +12,600 @@ static void bind_d(sqlite3_stmt* st, int idx, double v) {
         throw std::runtime_error("sqlite bind double failed");
 }
 
+// Пустой BLOB пишется как NULL
+static void bind_blob(sqlite3_stmt* st, int idx, const std::string& v) {
+    int rc = v.empty() ? sqlite3_bind_null(st, idx)
+                       : sqlite3_bind_blob(st, idx, v.data(), (int)v.size(), SQLITE_TRANSIENT);
+    if (rc != SQLITE_OK) throw std::runtime_error("sqlite bind blob failed");
+}
+
+static std::string column_blob(sqlite3_stmt* st, int idx) {
+    const void* p = sqlite3_column_blob(st, idx);
+    int n = sqlite3_column_bytes(st, idx);
+    return p ? std::string((const char*)p, (std::size_t)n) : std::string();
+}
+
+static const char* kRawStats = "COUNT(*), MIN(value), MAX(value), SUM(value)";
+static const char* kRollupStats = "SUM(count), MIN(min), MAX(max), SUM(sum)";
+
+// Партиции: raw и 1m - сутки, 5m и hourly - неделя, daily - без партиций.
+// Порядок и step_sec/sketch - как в Repo::kinds()
+const SqliteRepo::Kind SqliteRepo::kKinds[kKindCount] = {
+    {"raw",    "raw_measurements", 24 * 3600,     0,         "value",       kRawStats,    false},
+    {"1m",     "rollup_1m",        24 * 3600,     60,        "sum / count", kRollupStats, false},
+    {"5m",     "rollup_5m",        7 * 24 * 3600, 300,       "sum / count", kRollupStats, false},
+    {"hourly", "rollup_1h",        7 * 24 * 3600, 3600,      "sum / count", kRollupStats, true},
+    {"daily",  "rollup_1d",        0,             24 * 3600, "sum / count", kRollupStats, true},
+};
+
+// Читатель держит транзакцию, чтобы каталог и данные были из одного снимка:
+// партицию, которую писатель удалил после начала снимка, мы ещё видим.
+class SqliteRepo::ReadSnapshot {
+public:
+    explicit ReadSnapshot(SqliteRepo& r) : m_db(r.m_db), m_tx(r.m_db.read_only()) {
+        if (m_tx) m_db.begin_read();
+        try {
+            r.sync_catalog();
+        } catch (...) {
+            if (m_tx) m_db.rollback();
+            throw;
+        }
+    }
+    ~ReadSnapshot() {
+        if (m_tx) {
+            try { m_db.commit(); } catch (...) {}
+        }
+    }
+
+private:
+    SqliteDb& m_db;
+    bool m_tx;
+};
+
 SqliteRepo::SqliteRepo(SqliteDb& db) : m_db(db) {}
 
-// По kind возвращаем таблицу
-const char* SqliteRepo::table_of_kind(const std::string& kind) const {
-    if (kind == "raw") return "raw_measurements";
-    if (kind == "hourly") return "hourly_avg";
-    if (kind == "daily") return "daily_avg";
-    throw std::runtime_error("wrong kind");
+// Отрицательный номер пишется как n<N>: минус в имени таблицы недопустим
+std::string SqliteRepo::part_name(int k, std::int64_t idx) {
+    std::string name = std::string(kKinds[k].table) + "_p";
+    if (idx < 0) return name + "n" + std::to_string(-idx);
+    return name + std::to_string(idx);
+}
+
+std::int64_t SqliteRepo::part_of(int k, std::int64_t ts) {
+    std::int64_t ps = kKinds[k].part_sec;
+    std::int64_t q = ts / ps;
+    if (ts % ps < 0) --q;
+    return q;
+}
+
+// Таблица кластеризована по ts: строки лежат в B-дереве первичного ключа,
+// отдельного индекса нет. seq различает измерения с одинаковым ts.
+static std::string clustered_ddl(const std::string& name) {
+    return "CREATE TABLE IF NOT EXISTS " + name +
+           "(ts INTEGER NOT NULL, seq INTEGER NOT NULL, value REAL NOT NULL,"
+           " PRIMARY KEY(ts, seq)) WITHOUT ROWID;";
+}
+
+// Свёртка: одна строка на период; sketch - TDigest или NULL
+static std::string rollup_ddl(const std::string& name) {
+    return "CREATE TABLE IF NOT EXISTS " + name +
+           "(ts INTEGER NOT NULL PRIMARY KEY, count INTEGER NOT NULL,"
+           " sum REAL NOT NULL, min REAL NOT NULL, max REAL NOT NULL, sketch BLOB) WITHOUT ROWID;";
 }
 
-// Создаём таблицы
+// floor(ts / step) * step и для отрицательных ts
+static std::string floor_sql(std::int64_t step) {
+    const std::string st = std::to_string(step);
+    return "(ts - ((ts % " + st + ") + " + st + ") % " + st + ")";
+}
+
+// seq для строк старой rowid-таблицы: номер среди строк с тем же ts
+static const char* kSeqOfRowid = "row_number() OVER (PARTITION BY ts ORDER BY rowid) - 1";
+
+std::vector<std::string> SqliteRepo::tables_with_prefix(const std::string& prefix) {
+    auto st = m_db.prepare("SELECT name FROM sqlite_master WHERE type='table' AND substr(name,1,?)=?");
+    if (sqlite3_bind_int(st, 1, (int)prefix.size()) != SQLITE_OK ||
+        sqlite3_bind_text(st, 2, prefix.c_str(), -1, SQLITE_TRANSIENT) != SQLITE_OK)
+        throw std::runtime_error("sqlite bind text failed");
+
+    std::vector<std::string> out;
+    while (sqlite3_step(st) == SQLITE_ROW) out.push_back((const char*)sqlite3_column_text(st, 0));
+    return out;
+}
+
+bool SqliteRepo::table_exists(const std::string& name) {
+    auto st = m_db.prepare("SELECT 1 FROM sqlite_master WHERE type='table' AND name=?");
+    if (sqlite3_bind_text(st, 1, name.c_str(), -1, SQLITE_TRANSIENT) != SQLITE_OK)
+        throw std::runtime_error("sqlite bind text failed");
+    return sqlite3_step(st) == SQLITE_ROW;
+}
+
+bool SqliteRepo::has_column(const std::string& table, const std::string& column) {
+    auto st = m_db.prepare("SELECT 1 FROM pragma_table_info(?) WHERE name=?");
+    if (sqlite3_bind_text(st, 1, table.c_str(), -1, SQLITE_TRANSIENT) != SQLITE_OK ||
+        sqlite3_bind_text(st, 2, column.c_str(), -1, SQLITE_TRANSIENT) != SQLITE_OK)
+        throw std::runtime_error("sqlite bind text failed");
+    return sqlite3_step(st) == SQLITE_ROW;
+}
+
+long long SqliteRepo::user_version() {
+    auto st = m_db.prepare("PRAGMA user_version");
+    if (sqlite3_step(st) != SQLITE_ROW) return 0;
+    return (long long)sqlite3_column_int64(st, 0);
+}
+
+// Создаём таблицы и доводим схему до kSchemaVersion:
+// 0 - rowid-таблицы с индексом по ts (одна на kind или партиции),
+// 2 - партиции WITHOUT ROWID с ключом (ts, seq), hourly_avg/daily_avg хранят только avg,
+// 3 - свёртки 1m/5m/hourly/daily с count/sum/min/max,
+// 4 - у свёрток и rollup_open колонка sketch (скетч квантилей)
 void SqliteRepo::init_schema() {
-    m_db.exec(
-        "CREATE TABLE IF NOT EXISTS raw_measurements(ts INTEGER NOT NULL, value REAL NOT NULL);"
-        "CREATE INDEX IF NOT EXISTS idx_raw_ts ON raw_measurements(ts);"
-        "CREATE TABLE IF NOT EXISTS hourly_avg(ts INTEGER NOT NULL, value REAL NOT NULL);"
-        "CREATE INDEX IF NOT EXISTS idx_hourly_ts ON hourly_avg(ts);"
-        "CREATE TABLE IF NOT EXISTS daily_avg(ts INTEGER NOT NULL, value REAL NOT NULL);"
-        "CREATE INDEX IF NOT EXISTS idx_daily_ts ON daily_avg(ts);"
-    );
-}
-
-// вставка в таблицу
-void SqliteRepo::insert_any(const char* table, std::int64_t ts, double v) {
-    // INSERT INTO <table>(ts,value) VALUES(?,?)
-    std::string sql = std::string("INSERT INTO ") + table + "(ts,value) VALUES(?,?)";
-    sqlite3_stmt* st = nullptr;
-    if (sqlite3_prepare_v2(m_db.handle(), sql.c_str(), -1, &st, nullptr) != SQLITE_OK)
-        throw std::runtime_error("sqlite prepare insert failed");
+    std::lock_guard<std::mutex> lk(m_mu);
+
+    SqliteTx tx(m_db);
+    load_catalog();
+    long long ver = user_version();
+
+    m_db.exec(rollup_ddl(kKinds[kind_index("daily")].table));
+    // незакрытые периоды: переживают перезапуск без пересчёта по raw
+    m_db.exec("CREATE TABLE IF NOT EXISTS rollup_open(kind TEXT NOT NULL PRIMARY KEY, ts INTEGER NOT NULL,"
+              " count INTEGER NOT NULL, sum REAL NOT NULL, min REAL NOT NULL, max REAL NOT NULL,"
+              " sketch BLOB) WITHOUT ROWID;");
+
+    if (ver < 2) {
+        for (const auto& kv : m_parts[0]) rebuild_clustered(kv.second);
+        migrate_legacy_raw();
+    }
+
+    if (ver < 3) {
+        // hourly_avg, hourly_avg_p<N> и daily_avg -> свёртки; 1m/5m - из оставшихся raw
+        for (const auto& t : tables_with_prefix("hourly_avg")) fold_avg_table(kind_index("hourly"), t);
+        if (table_exists("daily_avg")) fold_avg_table(kind_index("daily"), "daily_avg");
+        backfill_from_raw(kind_index("1m"));
+        backfill_from_raw(kind_index("5m"));
+    }
+
+    if (ver < 4) {
+        // скетчей у старых строк нет; квантили считаются по строкам, где он есть
+        std::vector<std::string> tables = {"rollup_open", kKinds[kind_index("daily")].table};
+        for (int k = 1; k < kKindCount; ++k) {
+            for (const auto& kv : m_parts[k]) tables.push_back(kv.second);
+        }
+        for (const auto& t : tables) {
+            if (!has_column(t, "sketch")) m_db.exec("ALTER TABLE " + t + " ADD COLUMN sketch BLOB;");
+        }
+    }
+
+    m_db.exec("PRAGMA user_version=" + std::to_string(kSchemaVersion) + ";");
+    tx.commit();
+}
+
+// rowid-таблица + индекс -> кластеризованная таблица с тем же именем
+void SqliteRepo::rebuild_clustered(const std::string& table) {
+    const std::string tmp = table + "__new";
+    m_db.forget(table);
+    m_db.exec(clustered_ddl(tmp) +
+              "INSERT INTO " + tmp + "(ts,seq,value) SELECT ts, " + kSeqOfRowid + ", value FROM " + table + ";"
+              "DROP TABLE " + table + ";"
+              "ALTER TABLE " + tmp + " RENAME TO " + table + ";");
+}
+
+// Старая одна таблица raw_measurements раскладывается по партициям
+void SqliteRepo::migrate_legacy_raw() {
+    const std::string table = kKinds[0].table;
+    if (!table_exists(table)) return;
+
+    std::vector<std::int64_t> parts;
+    {
+        auto q = m_db.prepare("SELECT DISTINCT " + floor_sql(kKinds[0].part_sec) + " FROM " + table);
+        while (sqlite3_step(q) == SQLITE_ROW) parts.push_back((std::int64_t)sqlite3_column_int64(q, 0));
+    }
+
+    for (auto start : parts) {
+        std::int64_t idx = part_of(0, start);
+        create_part(0, idx);
+        auto ins = m_db.prepare("INSERT INTO " + part_name(0, idx) + "(ts,seq,value) SELECT ts, " +
+                                kSeqOfRowid + ", value FROM " + table + " WHERE ts>=? AND ts<?");
+        bind_i64(ins, 1, start);
+        bind_i64(ins, 2, start + kKinds[0].part_sec);
+        if (sqlite3_step(ins) != SQLITE_DONE)
+            throw std::runtime_error("sqlite migrate partition failed");
+    }
+    m_db.forget(table);
+    m_db.exec("DROP TABLE " + table + ";");
+}
+
+// Таблица средних (ts, value) -> свёртка kind. Сколько измерений было за
+// период, неизвестно, поэтому каждая старая строка считается одним измерением.
+void SqliteRepo::fold_avg_table(int k, const std::string& table) {
+    std::vector<DbRollup> rows;
+    {
+        auto q = m_db.prepare("SELECT ts, COUNT(*), SUM(value), MIN(value), MAX(value) FROM " + table +
+                              " GROUP BY ts");
+        while (sqlite3_step(q) == SQLITE_ROW) {
+            rows.push_back({(std::int64_t)sqlite3_column_int64(q, 0), (long long)sqlite3_column_int64(q, 1),
+                            sqlite3_column_double(q, 2), sqlite3_column_double(q, 3), sqlite3_column_double(q, 4)});
+        }
+    }
+    for (const auto& r : rows) upsert_rollup(k, r);
+    m_db.forget(table);
+    m_db.exec("DROP TABLE " + table + ";");
+}
+
+// Свёртка kind по raw, которые ещё хранятся
+void SqliteRepo::backfill_from_raw(int k) {
+    std::vector<DbRollup> rows;
+    for (const auto& kv : m_parts[0]) {
+        auto q = m_db.prepare("SELECT " + floor_sql(kKinds[k].step_sec) +
+                              " AS p, COUNT(*), SUM(value), MIN(value), MAX(value) FROM " + kv.second +
+                              " GROUP BY p");
+        while (sqlite3_step(q) == SQLITE_ROW) {
+            rows.push_back({(std::int64_t)sqlite3_column_int64(q, 0), (long long)sqlite3_column_int64(q, 1),
+                            sqlite3_column_double(q, 2), sqlite3_column_double(q, 3), sqlite3_column_double(q, 4)});
+        }
+    }
+    for (const auto& r : rows) upsert_rollup(k, r);
+}
+
+// Каталог перечитываем, только если схема поменялась (создали/удалили партицию)
+void SqliteRepo::sync_catalog() {
+    long long ver = 0;
+    {
+        auto st = m_db.prepare("PRAGMA schema_version");
+        if (sqlite3_step(st) == SQLITE_ROW) ver = (long long)sqlite3_column_int64(st, 0);
+    }
+    if (ver != m_schema_ver) load_catalog();
+}
+
+void SqliteRepo::load_catalog() {
+    {
+        auto st = m_db.prepare("PRAGMA schema_version");
+        if (sqlite3_step(st) == SQLITE_ROW) m_schema_ver = (long long)sqlite3_column_int64(st, 0);
+    }
+
+    for (int k = 0; k < kKindCount; ++k) {
+        if (kKinds[k].part_sec == 0) continue;
+
+        std::map<std::int64_t, std::string> parts;
+        const std::string prefix = std::string(kKinds[k].table) + "_p";
+
+        for (const auto& name : tables_with_prefix(prefix)) {
+            std::string num = name.substr(prefix.size());
+            try {
+                std::int64_t idx = num[0] == 'n' ? -std::stoll(num.substr(1)) : std::stoll(num);
+                if (part_name(k, idx) == name) parts.emplace(idx, name);
+            } catch (...) {
+                // чужая таблица с похожим именем
+            }
+        }
+
+        // запросы к исчезнувшим партициям из кэша больше не нужны
+        for (const auto& kv : m_parts[k]) {
+            if (!parts.count(kv.first)) m_db.forget(kv.second);
+        }
+        m_parts[k] = std::move(parts);
+    }
+}
+
+void SqliteRepo::create_part(int k, std::int64_t idx) {
+    std::string name = part_name(k, idx);
+    m_db.exec(kKinds[k].step_sec > 0 ? rollup_ddl(name) : clustered_ddl(name));
+    m_parts[k].emplace(idx, name);
+}
+
+// Таблицы, пересекающие [from, to], по возрастанию времени
+std::vector<std::string> SqliteRepo::tables_for(int k, std::int64_t from, std::int64_t to) const {
+    if (kKinds[k].part_sec == 0) return {kKinds[k].table};
+
+    std::vector<std::string> out;
+    if (from > to) return out;
+    auto& parts = m_parts[k];
+    for (auto it = parts.lower_bound(part_of(k, from)); it != parts.end() && it->first <= part_of(k, to); ++it) {
+        out.push_back(it->second);
+    }
+    return out;
+}
+
+const std::string& SqliteRepo::table_for_insert(int k, std::int64_t ts) {
+    static const std::string plain[kKindCount] = {kKinds[0].table, kKinds[1].table, kKinds[2].table,
+                                                  kKinds[3].table, kKinds[4].table};
+    if (kKinds[k].part_sec == 0) return plain[k];
+
+    std::int64_t idx = part_of(k, ts);
+    auto it = m_parts[k].find(idx);
+    if (it == m_parts[k].end()) {
+        create_part(k, idx);
+        it = m_parts[k].find(idx);
+    }
+    return it->second;
+}
+
+// вставка в таблицу (вызывается под m_mu)
+void SqliteRepo::insert_any(int k, std::int64_t ts, double v) {
+    // INSERT INTO <table>(ts,seq,value) VALUES(?1, следующий seq для ?1, ?2);
+    // подзапрос попадает в тот же правый лист B-дерева, куда идёт вставка
+    const std::string& table = table_for_insert(k, ts);
+    auto st = m_db.prepare("INSERT INTO " + table + "(ts,seq,value) VALUES(?1,"
+                           " (SELECT IFNULL(MAX(seq) + 1, 0) FROM " + table + " WHERE ts=?1), ?2)");
 
     bind_i64(st, 1, ts);
     bind_d(st, 2, v);
 
-    if (sqlite3_step(st) != SQLITE_DONE) {
-        sqlite3_finalize(st);
+    if (sqlite3_step(st) != SQLITE_DONE)
         throw std::runtime_error("sqlite step insert failed");
+}
+
+// Период уже есть (например, начат до перезапуска) - складываем с ним.
+// Скетчи SQL сложить не умеет: старый читаем и сливаем здесь (раз в период).
+// Скетч должен покрывать весь count строки: если у старой строки или у новой
+// части его нет, у строки его тоже не будет (в квантили она не войдёт)
+void SqliteRepo::upsert_rollup(int k, const DbRollup& r) {
+    const std::string& table = table_for_insert(k, r.ts);
+
+    std::string sketch = r.sketch;
+    if (!sketch.empty()) {
+        auto q = m_db.prepare("SELECT sketch FROM " + table + " WHERE ts=?");
+        bind_i64(q, 1, r.ts);
+        TDigest old, add;
+        if (sqlite3_step(q) == SQLITE_ROW) {
+            std::string prev = column_blob(q, 0);
+            if (TDigest::deserialize(prev.data(), prev.size(), old) &&
+                TDigest::deserialize(sketch.data(), sketch.size(), add)) {
+                old.merge(add);
+                sketch = old.serialize();
+            } else {
+                sketch.clear();
+            }
+        }
+    }
+
+    auto st = m_db.prepare("INSERT INTO " + table + "(ts,count,sum,min,max,sketch) VALUES(?,?,?,?,?,?)"
+                           " ON CONFLICT(ts) DO UPDATE SET count=count+excluded.count, sum=sum+excluded.sum,"
+                           " min=MIN(min,excluded.min), max=MAX(max,excluded.max),"
+                           " sketch=CASE WHEN sketch IS NULL THEN NULL ELSE excluded.sketch END");
+
+    bind_i64(st, 1, r.ts);
+    bind_i64(st, 2, r.count);
+    bind_d(st, 3, r.sum);
+    bind_d(st, 4, r.min);
+    bind_d(st, 5, r.max);
+    bind_blob(st, 6, sketch);
+
+    if (sqlite3_step(st) != SQLITE_DONE)
+        throw std::runtime_error("sqlite step upsert failed");
+}
+
+void SqliteRepo::insert_raw(std::int64_t ts, double v) {
+    std::lock_guard<std::mutex> lk(m_mu);
+    insert_any(0, ts, v);
+}
+
+void SqliteRepo::insert_rollup(const std::string& kind, const DbRollup& r) {
+    int k = kind_index(kind);
+    if (kKinds[k].step_sec == 0) throw std::runtime_error("wrong kind");
+    std::lock_guard<std::mutex> lk(m_mu);
+    upsert_rollup(k, r);
+}
+
+// Один BEGIN/COMMIT на всю пачку вместо автокоммита на каждую строку
+void SqliteRepo::insert_raw_batch(const std::vector<DbPoint>& pts) {
+    if (pts.empty()) return;
+    std::lock_guard<std::mutex> lk(m_mu);
+
+    SqliteTx tx(m_db);
+    sync_catalog();
+    for (const auto& p : pts) insert_any(0, p.ts, p.value);
+    tx.commit();
+}
+
+void SqliteRepo::write_batch(const DbBatch& b) {
+    if (b.empty()) return;
+    std::lock_guard<std::mutex> lk(m_mu);
+
+    SqliteTx tx(m_db);
+    // партиции могло удалить обслуживание со своего соединения
+    sync_catalog();
+    for (const auto& p : b.raw) insert_any(0, p.ts, p.value);
+    for (int k = 1; k < kKindCount; ++k) {
+        for (const auto& r : *b.rollups(kKinds[k].name)) upsert_rollup(k, r);
+    }
+    for (const auto& o : b.open) {
+        auto st = m_db.prepare("INSERT OR REPLACE INTO rollup_open(kind,ts,count,sum,min,max,sketch)"
+                               " VALUES(?,?,?,?,?,?,?)");
+        if (sqlite3_bind_text(st, 1, o.first, -1, SQLITE_STATIC) != SQLITE_OK)
+            throw std::runtime_error("sqlite bind text failed");
+        bind_i64(st, 2, o.second.ts);
+        bind_i64(st, 3, o.second.count);
+        bind_d(st, 4, o.second.sum);
+        bind_d(st, 5, o.second.min);
+        bind_d(st, 6, o.second.max);
+        bind_blob(st, 7, o.second.sketch);
+        if (sqlite3_step(st) != SQLITE_DONE)
+            throw std::runtime_error("sqlite step open period failed");
     }
-    sqlite3_finalize(st);
+    tx.commit();
 }
 
-void SqliteRepo::insert_raw(std::int64_t ts, double v)    { insert_any("raw_measurements", ts, v); }
-void SqliteRepo::insert_hourly(std::int64_t ts, double v) { insert_any("hourly_avg", ts, v); }
-void SqliteRepo::insert_daily(std::int64_t ts, double v)  { insert_any("daily_avg", ts, v); }
+std::optional<DbRollup> SqliteRepo::open_period(const std::string& kind) {
+    std::lock_guard<std::mutex> lk(m_mu);
+    auto st = m_db.prepare("SELECT ts,count,sum,min,max,sketch FROM rollup_open WHERE kind=?");
+    if (sqlite3_bind_text(st, 1, kind.c_str(), -1, SQLITE_TRANSIENT) != SQLITE_OK)
+        throw std::runtime_error("sqlite bind text failed");
+    if (sqlite3_step(st) != SQLITE_ROW) return std::nullopt;
+    return DbRollup{(std::int64_t)sqlite3_column_int64(st, 0), (long long)sqlite3_column_int64(st, 1),
+                    sqlite3_column_double(st, 2), sqlite3_column_double(st, 3), sqlite3_column_double(st, 4),
+                    column_blob(st, 5)};
+}
 
 std::optional<DbPoint> SqliteRepo::latest_raw() {
-    const char* sql = "SELECT ts,value FROM raw_measurements ORDER BY ts DESC LIMIT 1";
-    sqlite3_stmt* st = nullptr;
-    if (sqlite3_prepare_v2(m_db.handle(), sql, -1, &st, nullptr) != SQLITE_OK)
-        throw std::runtime_error("sqlite prepare latest failed");
-
-    int rc = sqlite3_step(st);
-    if (rc == SQLITE_ROW) {
-        DbPoint p;
-        p.ts = (std::int64_t)sqlite3_column_int64(st, 0);
-        p.value = sqlite3_column_double(st, 1);
-        sqlite3_finalize(st);
-        return p;
-    }
-    sqlite3_finalize(st);
+    std::lock_guard<std::mutex> lk(m_mu);
+    ReadSnapshot snap(*this);
+
+    // с самой новой партиции; пустые пропускаем
+    for (auto it = m_parts[0].rbegin(); it != m_parts[0].rend(); ++it) {
+        auto st = m_db.prepare("SELECT ts,value FROM " + it->second + " ORDER BY ts DESC LIMIT 1");
+        if (sqlite3_step(st) == SQLITE_ROW) {
+            DbPoint p;
+            p.ts = (std::int64_t)sqlite3_column_int64(st, 0);
+            p.value = sqlite3_column_double(st, 1);
+            return p;
+        }
+    }
     return std::nullopt;
 }
 
-// Статистика за период
-DbStats SqliteRepo::stats(const std::string& kind, std::int64_t from, std::int64_t to) {
-    const char* table = table_of_kind(kind);
+std::optional<std::int64_t> SqliteRepo::max_ts(const std::string& kind) {
+    int k = kind_index(kind);
+    std::lock_guard<std::mutex> lk(m_mu);
+    ReadSnapshot snap(*this);
 
-    // SELECT COUNT(*), MIN(value), MAX(value), AVG(value) FROM table WHERE ts>=? AND ts<=?
-    std::string sql = std::string("SELECT COUNT(*), MIN(value), MAX(value), AVG(value) FROM ")
-                    + table + " WHERE ts>=? AND ts<=?";
+    auto tables = tables_for(k, INT64_MIN, INT64_MAX);
+    for (auto it = tables.rbegin(); it != tables.rend(); ++it) {
+        auto st = m_db.prepare("SELECT MAX(ts) FROM " + *it);
+        if (sqlite3_step(st) == SQLITE_ROW && sqlite3_column_type(st, 0) != SQLITE_NULL)
+            return (std::int64_t)sqlite3_column_int64(st, 0);
+    }
+    return std::nullopt;
+}
 
-    sqlite3_stmt* st = nullptr;
-    if (sqlite3_prepare_v2(m_db.handle(), sql.c_str(), -1, &st, nullptr) != SQLITE_OK)
-        throw std::runtime_error("sqlite prepare stats failed");
+std::optional<std::int64_t> SqliteRepo::min_ts(const std::string& kind) {
+    int k = kind_index(kind);
+    std::lock_guard<std::mutex> lk(m_mu);
+    ReadSnapshot snap(*this);
 
-    bind_i64(st, 1, from);
-    bind_i64(st, 2, to);
+    for (const auto& table : tables_for(k, INT64_MIN, INT64_MAX)) {
+        auto st = m_db.prepare("SELECT MIN(ts) FROM " + table);
+        if (sqlite3_step(st) == SQLITE_ROW && sqlite3_column_type(st, 0) != SQLITE_NULL)
+            return (std::int64_t)sqlite3_column_int64(st, 0);
+    }
+    return std::nullopt;
+}
+
+// Статистика за период: по каждой партиции, потом сводим
+DbStats SqliteRepo::stats(const std::string& kind, std::int64_t from, std::int64_t to) {
+    int k = kind_index(kind);
+    std::lock_guard<std::mutex> lk(m_mu);
+    ReadSnapshot snap(*this);
 
     DbStats s{};
-    if (sqlite3_step(st) == SQLITE_ROW) {
-        s.count = (long long)sqlite3_column_int64(st, 0);
-        if (s.count > 0) {
-            s.min = sqlite3_column_double(st, 1);
-            s.max = sqlite3_column_double(st, 2);
-            s.avg = sqlite3_column_double(st, 3);
-        }
+    double sum = 0;
+    for (const auto& table : tables_for(k, from, to)) {
+        // SELECT <count, min, max, sum> FROM table WHERE ts>=? AND ts<=?
+        auto st = m_db.prepare(std::string("SELECT ") + kKinds[k].stats_sql + " FROM " + table +
+                               " WHERE ts>=? AND ts<=?");
+        bind_i64(st, 1, from);
+        bind_i64(st, 2, to);
+
+        if (sqlite3_step(st) != SQLITE_ROW) continue;
+        long long cnt = (long long)sqlite3_column_int64(st, 0);
+        if (cnt == 0) continue;
+
+        double mn = sqlite3_column_double(st, 1), mx = sqlite3_column_double(st, 2);
+        if (s.count == 0) { s.min = mn; s.max = mx; }
+        else { s.min = std::min(s.min, mn); s.max = std::max(s.max, mx); }
+        sum += sqlite3_column_double(st, 3);
+        s.count += cnt;
     }
-    sqlite3_finalize(st);
+    if (s.count > 0) s.avg = sum / (double)s.count;
     return s;
 }
 
-std::vector<DbPoint> SqliteRepo::series(const std::string& kind, std::int64_t from, std::int64_t to, int limit) {
-    const char* table = table_of_kind(kind);
-    if (limit <= 0) limit = 1000;
+// raw - скетч строится по измерениям (их мало: raw хранится недолго),
+// hourly/daily - сливаются скетчи строк; строки без скетча пропускаются
+TDigest SqliteRepo::sketch(const std::string& kind, std::int64_t from, std::int64_t to) {
+    int k = kind_index(kind);
+    if (k != 0 && !kKinds[k].sketch) throw std::runtime_error("no sketch for kind");
+
+    std::lock_guard<std::mutex> lk(m_mu);
+    ReadSnapshot snap(*this);
 
-    std::string sql = std::string("SELECT ts,value FROM ") + table +
-                      " WHERE ts>=? AND ts<=? ORDER BY ts ASC LIMIT ?";
+    TDigest d;
+    if (k == 0) {
+        for_each_locked(k, from, to, [&](const DbPoint& p) { d.add(p.value); return true; }, -1);
+        return d;
+    }
 
-    sqlite3_stmt* st = nullptr;
-    if (sqlite3_prepare_v2(m_db.handle(), sql.c_str(), -1, &st, nullptr) != SQLITE_OK)
-        throw std::runtime_error("sqlite prepare series failed");
+    for (const auto& table : tables_for(k, from, to)) {
+        auto st = m_db.prepare("SELECT sketch FROM " + table + " WHERE ts>=? AND ts<=? AND sketch IS NOT NULL");
+        bind_i64(st, 1, from);
+        bind_i64(st, 2, to);
 
-    bind_i64(st, 1, from);
-    bind_i64(st, 2, to);
-    if (sqlite3_bind_int(st, 3, limit) != SQLITE_OK)
-        throw std::runtime_error("sqlite bind limit failed");
+        TDigest part;
+        while (sqlite3_step(st) == SQLITE_ROW) {
+            const void* p = sqlite3_column_blob(st, 0);
+            if (p && TDigest::deserialize(p, (std::size_t)sqlite3_column_bytes(st, 0), part)) d.merge(part);
+        }
+    }
+    return d;
+}
+
+void SqliteRepo::for_each(const std::string& kind, std::int64_t from, std::int64_t to,
+                          const std::function<bool(const DbPoint&)>& fn, int limit) {
+    int k = kind_index(kind);
+    std::lock_guard<std::mutex> lk(m_mu);
+    ReadSnapshot snap(*this);
+    for_each_locked(k, from, to, fn, limit);
+}
+
+// Партиции идут по времени, поэтому общий порядок по ts сохраняется
+void SqliteRepo::for_each_locked(int k, std::int64_t from, std::int64_t to,
+                                 const std::function<bool(const DbPoint&)>& fn, int limit) {
+    for (const auto& table : tables_for(k, from, to)) {
+        auto st = m_db.prepare("SELECT ts, " + std::string(kKinds[k].value_sql) + " FROM " + table +
+                               " WHERE ts>=? AND ts<=? ORDER BY ts ASC LIMIT ?");
+
+        bind_i64(st, 1, from);
+        bind_i64(st, 2, to);
+        if (sqlite3_bind_int(st, 3, limit) != SQLITE_OK)
+            throw std::runtime_error("sqlite bind limit failed");
 
-    std::vector<DbPoint> out;
-    while (sqlite3_step(st) == SQLITE_ROW) {
-        DbPoint p;
-        p.ts = (std::int64_t)sqlite3_column_int64(st, 0);
-        p.value = sqlite3_column_double(st, 1);
-        out.push_back(p);
+        while (sqlite3_step(st) == SQLITE_ROW) {
+            DbPoint p;
+            p.ts = (std::int64_t)sqlite3_column_int64(st, 0);
+            p.value = sqlite3_column_double(st, 1);
+            if (!fn(p)) return;
+            if (limit > 0 && --limit == 0) return;
+        }
     }
-    sqlite3_finalize(st);
-    return out;
 }
 
-void SqliteRepo::retention(const std::string& kind, std::int64_t keep_from) {
-    const char* table = table_of_kind(kind);
-    std::string sql = std::string("DELETE FROM ") + table + " WHERE ts < ?";
+// Партиции целиком раньше keep_from удаляются через DROP TABLE,
+// в пограничной удаляются только старые строки
+bool SqliteRepo::retention_step(const std::string& kind, std::int64_t keep_from, int max_rows) {
+    int k = kind_index(kind);
+    std::lock_guard<std::mutex> lk(m_mu);
+
+    SqliteTx tx(m_db);
+    sync_catalog();
+
+    std::string table = kKinds[k].table;
+    if (kKinds[k].part_sec > 0) {
+        auto& parts = m_parts[k];
+        if (!parts.empty() && parts.begin()->first < part_of(k, keep_from)) {
+            std::string name = parts.begin()->second;
+            m_db.forget(name);
+            m_db.exec("DROP TABLE IF EXISTS " + name + ";");
+            parts.erase(parts.begin());
+            tx.commit();
+            return true;
+        }
 
-    sqlite3_stmt* st = nullptr;
-    if (sqlite3_prepare_v2(m_db.handle(), sql.c_str(), -1, &st, nullptr) != SQLITE_OK)
-        throw std::runtime_error("sqlite prepare retention failed");
+        auto it = parts.find(part_of(k, keep_from));
+        if (it == parts.end()) return false;
+        table = it->second;
+    }
 
+    // DELETE ... LIMIT без SQLITE_ENABLE_UPDATE_DELETE_LIMIT недоступен, поэтому через ключ
+    const std::string key = kKinds[k].step_sec > 0 ? "ts" : "ts,seq";
+    auto st = m_db.prepare("DELETE FROM " + table + " WHERE (" + key + ") IN (SELECT " + key + " FROM " + table +
+                           " WHERE ts < ? ORDER BY ts LIMIT ?)");
     bind_i64(st, 1, keep_from);
-    sqlite3_step(st);
-    sqlite3_finalize(st);
+    if (sqlite3_bind_int(st, 2, max_rows) != SQLITE_OK)
+        throw std::runtime_error("sqlite bind limit failed");
+    if (sqlite3_step(st) != SQLITE_DONE)
+        throw std::runtime_error("sqlite step delete failed");
+
+    int n = sqlite3_changes(m_db.handle());
+    tx.commit();
+    return max_rows > 0 && n >= max_rows;
 }
@@ -1,46 +1,89 @@
 #pragma once
+#include "repo.hpp"
 #include "sqlite_db.hpp"
 #include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
 #include <optional>
 #include <string>
 #include <vector>
 
-// Точка измерения
-struct DbPoint {
-    std::int64_t ts;
-    double value;
-};
-
-// Статистика
-struct DbStats {
-    long long count = 0;
-    double min = 0, max = 0, avg = 0;
-};
-
-// Слой доступа к бд
-class SqliteRepo {
+// Слой доступа к бд.
+// kind: raw - измерения, 1m/5m/hourly/daily - свёртки count/sum/min/max.
+// Всё, кроме daily, лежит в партициях по времени: <table>_p<N>, N = ts / длина
+// партиции. Retention удаляет партиции целиком, запросы идут только в
+// партиции, пересекающие период. raw - WITHOUT ROWID с ключом (ts, seq),
+// свёртки - WITHOUT ROWID с ключом ts; у hourly и daily ещё скетч квантилей.
+class SqliteRepo : public Repo {
 public:
     explicit SqliteRepo(SqliteDb& db);
 
     void init_schema();
-    
-    // Вставка данных
-    void insert_raw(std::int64_t ts, double v);
-    void insert_hourly(std::int64_t ts, double v);
-    void insert_daily(std::int64_t ts, double v);
 
-    // Последняя запись бд
-    std::optional<DbPoint> latest_raw();
+    void insert_raw(std::int64_t ts, double v) override;
+    void insert_rollup(const std::string& kind, const DbRollup& r) override;
+
+    // Один BEGIN/COMMIT на пачку
+    void insert_raw_batch(const std::vector<DbPoint>& pts) override;
+    void write_batch(const DbBatch& b) override;
+
+    std::optional<DbRollup> open_period(const std::string& kind) override;
+    std::optional<DbPoint> latest_raw() override;
 
-    // Статистика по таблице <kind> за период <from> .. <to>
-    DbStats stats(const std::string& kind, std::int64_t from, std::int64_t to);
-    std::vector<DbPoint> series(const std::string& kind, std::int64_t from, std::int64_t to, int limit);
+    std::optional<std::int64_t> max_ts(const std::string& kind) override;
+    std::optional<std::int64_t> min_ts(const std::string& kind) override;
 
-    void retention(const std::string& kind, std::int64_t keep_from);
+    DbStats stats(const std::string& kind, std::int64_t from, std::int64_t to) override;
+    TDigest sketch(const std::string& kind, std::int64_t from, std::int64_t to) override;
+    void for_each(const std::string& kind, std::int64_t from, std::int64_t to,
+                  const std::function<bool(const DbPoint&)>& fn, int limit = -1) override;
+
+    bool retention_step(const std::string& kind, std::int64_t keep_from, int max_rows) override;
 
 private:
+    struct Kind {
+        const char* name;
+        const char* table;
+        std::int64_t part_sec;   // длина партиции, 0 - без партиций
+        std::int64_t step_sec;   // период свёртки, 0 - raw
+        const char* value_sql;   // значение точки для series
+        const char* stats_sql;   // count, min, max, sum
+        bool sketch;             // колонка sketch заполняется
+    };
+    static const Kind kKinds[kKindCount];
+    static constexpr long long kSchemaVersion = 4;   // PRAGMA user_version
+
+    // Снимок для чтения: read-транзакция (на read-only соединении) + свежий каталог
+    class ReadSnapshot;
+
     SqliteDb& m_db;
+    // Кэшированные запросы соединения нельзя шагать из нескольких потоков сразу
+    std::mutex m_mu;
+
+    // Каталог партиций: номер партиции -> имя таблицы
+    std::map<std::int64_t, std::string> m_parts[kKindCount];
+    long long m_schema_ver = -1;
+
+    static std::string part_name(int k, std::int64_t idx);
+    static std::int64_t part_of(int k, std::int64_t ts);
+
+    void sync_catalog();
+    void load_catalog();
+    std::vector<std::string> tables_for(int k, std::int64_t from, std::int64_t to) const;
+    const std::string& table_for_insert(int k, std::int64_t ts);
+    void create_part(int k, std::int64_t idx);
+    void migrate_legacy_raw();
+    void rebuild_clustered(const std::string& table);
+    void fold_avg_table(int k, const std::string& table);
+    void backfill_from_raw(int k);
+    bool table_exists(const std::string& name);
+    bool has_column(const std::string& table, const std::string& column);
+    std::vector<std::string> tables_with_prefix(const std::string& prefix);
+    long long user_version();
 
-    const char* table_of_kind(const std::string& kind) const;
-    void insert_any(const char* table, std::int64_t ts, double v);
+    void insert_any(int k, std::int64_t ts, double v);
+    void upsert_rollup(int k, const DbRollup& r);
+    void for_each_locked(int k, std::int64_t from, std::int64_t to,
+                         const std::function<bool(const DbPoint&)>& fn, int limit);
 };
@@ -0,0 +1,180 @@
+#include "tdigest.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+static constexpr double kPi = 3.14159265358979323846;
+
+// Масштабная функция k1: k(q) = c / 2pi * asin(2q - 1) и обратная к ней
+static double k_of(double q, double c) { return c / (2.0 * kPi) * std::asin(2.0 * q - 1.0); }
+static double q_of(double k, double c) {
+    if (k >= c / 4.0) return 1.0;
+    return (std::sin(k * 2.0 * kPi / c) + 1.0) / 2.0;
+}
+
+TDigest::TDigest(double compression) : m_compression(compression) {}
+
+void TDigest::add(double v, double w) {
+    if (w <= 0.0 || std::isnan(v)) return;
+    if (empty()) {
+        m_min = v;
+        m_max = v;
+    } else {
+        m_min = std::min(m_min, v);
+        m_max = std::max(m_max, v);
+    }
+    m_buf.push_back({v, w});
+    m_buf_total += w;
+    // буфер в несколько раз больше итогового числа центроидов: сортировка окупается
+    if (m_buf.size() >= (std::size_t)(m_compression * 5)) compress();
+}
+
+void TDigest::merge(const TDigest& o) {
+    if (o.empty()) return;
+    if (empty()) {
+        m_min = o.m_min;
+        m_max = o.m_max;
+    } else {
+        m_min = std::min(m_min, o.m_min);
+        m_max = std::max(m_max, o.m_max);
+    }
+    o.compress();
+    m_buf.insert(m_buf.end(), o.m_cent.begin(), o.m_cent.end());
+    m_buf_total += o.m_total;
+    compress();
+}
+
+// Слияние буфера с центроидами: идём по возрастанию mean и растим текущий
+// центроид, пока его правая граница по k не ушла дальше чем на 1 от левой
+void TDigest::compress() const {
+    if (m_buf.empty()) return;
+
+    m_buf.insert(m_buf.end(), m_cent.begin(), m_cent.end());
+    std::sort(m_buf.begin(), m_buf.end(), [](const Centroid& a, const Centroid& b) { return a.mean < b.mean; });
+
+    double total = m_total + m_buf_total;
+    m_cent.clear();
+
+    Centroid cur = m_buf.front();
+    double before = 0.0;   // вес всех центроидов левее cur
+    double limit = total * q_of(k_of(0.0, m_compression) + 1.0, m_compression);
+
+    for (std::size_t i = 1; i < m_buf.size(); ++i) {
+        const Centroid& c = m_buf[i];
+        if (before + cur.weight + c.weight <= limit) {
+            cur.weight += c.weight;
+            cur.mean += (c.mean - cur.mean) * c.weight / cur.weight;
+        } else {
+            before += cur.weight;
+            m_cent.push_back(cur);
+            limit = total * q_of(k_of(before / total, m_compression) + 1.0, m_compression);
+            cur = c;
+        }
+    }
+    m_cent.push_back(cur);
+
+    m_buf.clear();
+    m_total = total;
+    m_buf_total = 0.0;
+}
+
+// Линейная интерполяция между серединами соседних центроидов;
+// у краёв - до min/max
+double TDigest::quantile(double q) const {
+    if (empty()) return std::numeric_limits<double>::quiet_NaN();
+    compress();
+
+    q = std::clamp(q, 0.0, 1.0);
+    if (m_cent.size() == 1) return m_cent.front().mean;
+
+    double index = q * m_total;
+    const auto& first = m_cent.front();
+    if (index < first.weight / 2.0) {
+        if (first.weight <= 1.0) return m_min;
+        return m_min + (first.mean - m_min) * index / (first.weight / 2.0);
+    }
+
+    double cum = first.weight / 2.0;
+    for (std::size_t i = 0; i + 1 < m_cent.size(); ++i) {
+        const auto& a = m_cent[i];
+        const auto& b = m_cent[i + 1];
+        double span = (a.weight + b.weight) / 2.0;
+        if (index < cum + span) {
+            double t = (index - cum) / span;
+            return a.mean + (b.mean - a.mean) * t;
+        }
+        cum += span;
+    }
+
+    const auto& last = m_cent.back();
+    if (last.weight <= 1.0) return m_max;
+    double t = std::min((index - cum) / (last.weight / 2.0), 1.0);
+    return last.mean + (m_max - last.mean) * t;
+}
+
+static void put_u32(std::string& out, std::uint32_t v) {
+    for (int i = 0; i < 4; ++i) out.push_back((char)((v >> (8 * i)) & 0xff));
+}
+
+static void put_f64(std::string& out, double v) {
+    std::uint64_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    for (int i = 0; i < 8; ++i) out.push_back((char)((bits >> (8 * i)) & 0xff));
+}
+
+static std::uint64_t get_le(const unsigned char* p, int n) {
+    std::uint64_t v = 0;
+    for (int i = 0; i < n; ++i) v |= (std::uint64_t)p[i] << (8 * i);
+    return v;
+}
+
+static double get_f64(const unsigned char* p) {
+    std::uint64_t bits = get_le(p, 8);
+    double v;
+    std::memcpy(&v, &bits, sizeof(v));
+    return v;
+}
+
+static const char kMagic[3] = {'T', 'D', '1'};
+static constexpr std::size_t kHeader = sizeof(kMagic) + 3 * 8 + 4;
+
+std::string TDigest::serialize() const {
+    compress();
+
+    std::string out(kMagic, sizeof(kMagic));
+    out.reserve(kHeader + m_cent.size() * 16);
+    put_f64(out, m_compression);
+    put_f64(out, m_min);
+    put_f64(out, m_max);
+    put_u32(out, (std::uint32_t)m_cent.size());
+    for (const auto& c : m_cent) {
+        put_f64(out, c.mean);
+        put_f64(out, c.weight);
+    }
+    return out;
+}
+
+bool TDigest::deserialize(const void* data, std::size_t size, TDigest& out) {
+    const auto* p = (const unsigned char*)data;
+    if (size < kHeader || std::memcmp(p, kMagic, sizeof(kMagic)) != 0) return false;
+    p += sizeof(kMagic);
+
+    double compression = get_f64(p);
+    std::size_t n = (std::size_t)get_le(p + 24, 4);
+    if (!(compression > 0.0) || size != kHeader + n * 16) return false;
+
+    TDigest d(compression);
+    d.m_min = get_f64(p + 8);
+    d.m_max = get_f64(p + 16);
+    p += 28;
+    d.m_cent.reserve(n);
+    for (std::size_t i = 0; i < n; ++i, p += 16) {
+        Centroid c{get_f64(p), get_f64(p + 8)};
+        if (!(c.weight > 0.0)) return false;
+        d.m_cent.push_back(c);
+        d.m_total += c.weight;
+    }
+    out = std::move(d);
+    return true;
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Скетч квантилей t-digest (Dunning, merging-вариант).
+// Значения копятся в буфере и сливаются в центроиды (mean, weight); у краёв
+// распределения центроиды мельче (масштабная функция k1), поэтому p99/p1
+// точнее медианы. Центроидов не больше ~compression; скетчи сливаются,
+// поэтому квантили за месяц собираются из часовых скетчей.
+class TDigest {
+public:
+    TDigest() = default;
+    explicit TDigest(double compression);
+
+    void add(double v, double w = 1.0);
+    void merge(const TDigest& o);
+
+    bool empty() const { return m_total + m_buf_total == 0.0; }
+    double count() const { return m_total + m_buf_total; }
+    double min() const { return m_min; }
+    double max() const { return m_max; }
+
+    // q в [0, 1]; пустой скетч - NaN
+    double quantile(double q) const;
+
+    // Двоичный вид для BLOB: "TD1" | f64 compression | f64 min | f64 max | u32 n | n x (f64 mean, f64 weight), LE
+    std::string serialize() const;
+    static bool deserialize(const void* data, std::size_t size, TDigest& out);
+
+private:
+    struct Centroid {
+        double mean;
+        double weight;
+    };
+
+    double m_compression = 100.0;
+    double m_min = 0.0, m_max = 0.0;
+
+    // Несжатое состояние тоже часть значения: const-методы сжимают по месту
+    mutable std::vector<Centroid> m_cent;
+    mutable std::vector<Centroid> m_buf;
+    mutable double m_total = 0.0;       // вес в m_cent
+    mutable double m_buf_total = 0.0;   // вес в m_buf
+
+    void compress() const;
+};
@@ -0,0 +1,57 @@
+#include "log_format.hpp"
+
+#include <cstdlib>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+static void usage() {
+    std::cerr <<
+      "temp_logconv: text <-> binary log (segment or old single file)\n"
+      "  [--to text|bin] <in> <out>\n"
+      "  input format is detected by header; default --to is the other one\n";
+}
+
+int main(int argc, char** argv) {
+    std::string inPath, outPath;
+    bool haveTo = false;
+    LogFormat to = LogFormat::Text;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string a = argv[i];
+        auto need = [&](const char* name) -> std::string {
+            if (i + 1 >= argc) { std::cerr << "Missing value for " << name << "\n"; std::exit(2); }
+            return argv[++i];
+        };
+
+        if (a == "--to") {
+            if (!parse_log_format(need("--to"), to)) { std::cerr << "Error: bad --to\n"; return 2; }
+            haveTo = true;
+        }
+        else if (a == "-h" || a == "--help") { usage(); return 0; }
+        else if (inPath.empty()) inPath = a;
+        else if (outPath.empty()) outPath = a;
+        else { std::cerr << "Unknown arg: " << a << "\n"; usage(); return 2; }
+    }
+    if (inPath.empty() || outPath.empty()) { usage(); return 2; }
+
+    std::deque<LogRecord> recs;
+    auto info = read_log_file(inPath, timeutil::TP::min(), recs);
+    if (!info.ok) { std::cerr << "Error: can't read " << inPath << "\n"; return 1; }
+    if (!haveTo) to = info.format == LogFormat::Text ? LogFormat::Binary : LogFormat::Text;
+
+    std::ofstream out(outPath, std::ios::binary | std::ios::trunc);
+    if (!out) { std::cerr << "Error: can't open " << outPath << "\n"; return 1; }
+
+    char buf[kLogLineMax];
+    out.write(buf, (std::streamsize)encode_log_header(to, buf));
+    for (const auto& r : recs) out.write(buf, (std::streamsize)encode_log_record(to, r, buf));
+    out.close();
+    if (!out) { std::cerr << "Error: write failed " << outPath << "\n"; return 1; }
+
+    if (info.valid_bytes < info.size)
+        std::cerr << "note: dropped " << (info.size - info.valid_bytes) << " bytes of torn tail\n";
+    std::cerr << recs.size() << " records -> " << (to == LogFormat::Binary ? "bin" : "text") << "\n";
+    return 0;
+}
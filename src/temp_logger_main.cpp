@@ -3,10 +3,15 @@
 #include "retention.hpp"
 #include "timeutil.hpp"
 
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <csignal>
 #include <cstdlib>
 #include <iostream>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <algorithm>
 
 static void usage() {
@@ -16,10 +21,21 @@ static void usage() {
       "  [--port COM3|/dev/ttyUSB0] [--baud 9600]\n"
       "  [--raw measurements.log] [--hour hourly_avg.log] [--day daily_avg.log]\n"
       "  [--raw-keep-sec 86400] [--hour-keep-sec 2592000]\n"
-      "  [--compact-sec 300]\n"
+      "  [--compact-sec 300] [--segment-sec 3600]\n"
+      "  [--sync flush|fdatasync] [--flush-ms 1000] [--write-buffer-kb 64]\n"
+      "  [--format text|bin]\n"
       "  (old) [--compact-min 5]\n";
 }
 
+// SIGINT/SIGTERM: обработчик только запоминает сигнал, логи сбрасывает поток сброса.
+// atomic, а не volatile sig_atomic_t: флаг читает другой поток
+static std::atomic<int> g_signal{0};
+static_assert(std::atomic<int>::is_always_lock_free, "g_signal is stored from a signal handler");
+
+static void on_signal(int sig) {
+    g_signal.store(sig);
+}
+
 static bool parse_temp_line(const std::string& line, double& out) {
     std::string s = line;
 
@@ -52,6 +68,11 @@ int main(int argc, char** argv) {
     long long rawKeepSec  = 24 * 3600;         // 24 часа
     long long hourKeepSec = 30 * 24 * 3600;    // 30 дней
     long long compactSec  = 5 * 60;            // 5 минут
+    long long segmentSec  = 3600;              // сегмент raw-лога - час
+
+    // raw пишется через буфер: сброс по заполнению или раз в flush_ms
+    LogWriterConfig rawOut;
+    LogFormat format = LogFormat::Text;
 
     for (int i = 1; i < argc; ++i) {
         std::string a = argv[i];
@@ -71,6 +92,15 @@ int main(int argc, char** argv) {
         else if (a == "--raw-keep-sec")  rawKeepSec  = std::stoll(need("--raw-keep-sec"));
         else if (a == "--hour-keep-sec") hourKeepSec = std::stoll(need("--hour-keep-sec"));
         else if (a == "--compact-sec")   compactSec  = std::stoll(need("--compact-sec"));
+        else if (a == "--segment-sec")   segmentSec  = std::stoll(need("--segment-sec"));
+        else if (a == "--sync") {
+            if (!parse_sync_policy(need("--sync"), rawOut.sync)) { std::cerr << "Error: bad --sync\n"; return 2; }
+        }
+        else if (a == "--flush-ms") rawOut.flush_ms = std::stoll(need("--flush-ms"));
+        else if (a == "--write-buffer-kb") rawOut.buffer_bytes = std::stoul(need("--write-buffer-kb")) * 1024;
+        else if (a == "--format") {
+            if (!parse_log_format(need("--format"), format)) { std::cerr << "Error: bad --format\n"; return 2; }
+        }
 
         else if (a == "--compact-min") compactMin = std::stoi(need("--compact-min"));
         else if (a == "-h" || a == "--help") { usage(); return 0; }
@@ -81,13 +111,20 @@ int main(int argc, char** argv) {
     auto now = clock::now();
 
     // raw: последние 24 часа
-    RetentionLog rawLog(rawPath, [rawKeepSec](auto n){ return n - std::chrono::seconds(rawKeepSec); });
+    RetentionLog rawLog(rawPath, [rawKeepSec](auto n){ return n - std::chrono::seconds(rawKeepSec); },
+                        segmentSec, rawOut, format);
 
-    // hourly: последние 30 дней
-    RetentionLog hourLog(hourPath, [hourKeepSec](auto n){ return n - std::chrono::seconds(hourKeepSec); });
+    // средние приходят раз в час/день - сразу в ОС, fdatasync - если он задан
+    LogWriterConfig avgOut = rawOut;
+    avgOut.flush_ms = 0;
 
-    // daily: текущий год
-    RetentionLog dayLog(dayPath, [](auto n){ return timeutil::start_of_current_year(n); });
+    // hourly: последние 30 дней, сегмент - сутки
+    RetentionLog hourLog(hourPath, [hourKeepSec](auto n){ return n - std::chrono::seconds(hourKeepSec); },
+                         24 * 3600, avgOut, format);
+
+    // daily: текущий год, сегмент - 30 дней
+    RetentionLog dayLog(dayPath, [](auto n){ return timeutil::start_of_current_year(n); }, 30 * 24 * 3600,
+                        avgOut, format);
 
     // при старте обрежем уже существующие файлы
     rawLog.load_and_compact(now);
@@ -107,8 +144,9 @@ int main(int argc, char** argv) {
         return 2;
     }
 
-    Aggregator hourAgg(timeutil::floor_to_hour);
-    Aggregator dayAgg(timeutil::floor_to_day);
+    // в файлы пишется только среднее - копим count и sum
+    Aggregator<period::Hour, stats::Sum> hourAgg;
+    Aggregator<period::Day, stats::Sum> dayAgg;
 
     auto nextCompact = clock::now() + std::chrono::seconds(compactSec);
 
@@ -117,10 +155,37 @@ int main(int argc, char** argv) {
               << " hourKeepSec=" << hourKeepSec
               << " compactSec=" << compactSec << "\n";
 
+    // readLine блокируется, пока вход молчит: буфер raw по flush_ms и
+    // сброс при сигнале - в отдельном потоке. Логи - под logMu
+    std::mutex logMu;
+    std::condition_variable stopCv;
+    bool stop = false;
+
+    std::signal(SIGINT, on_signal);
+    std::signal(SIGTERM, on_signal);
+
+    std::thread flusher([&] {
+        std::unique_lock<std::mutex> lk(logMu);
+        while (!stop) {
+            if (int sig = g_signal.load()) {
+                rawLog.flush();
+                hourLog.flush();
+                dayLog.flush();
+                std::cerr << "temp_logger finished (signal " << sig << ")\n";
+                std::_Exit(128 + sig);
+            }
+            rawLog.flush_if_due();
+            hourLog.flush_if_due();
+            dayLog.flush_if_due();
+            stopCv.wait_for(lk, std::chrono::milliseconds(100));
+        }
+    });
+
     std::string line;
     while (reader->readLine(line)) {
         double temp = 0.0;
         if (!parse_temp_line(line, temp)) continue;
+        std::lock_guard<std::mutex> lk(logMu);
         auto ts = clock::now();
 
         // все измерения
@@ -128,12 +193,12 @@ int main(int argc, char** argv) {
 
         // среднее за час
         if (auto fin = hourAgg.push(ts, temp)) {
-            hourLog.append({fin->period_start, fin->avg});
+            hourLog.append({fin->period_start, fin->avg()});
         }
 
         // среднее за день
         if (auto fin = dayAgg.push(ts, temp)) {
-            dayLog.append({fin->period_start, fin->avg});
+            dayLog.append({fin->period_start, fin->avg()});
 
             // на случай смены года
             dayLog.compact_to_disk(clock::now());
@@ -149,6 +214,17 @@ int main(int argc, char** argv) {
         }
     }
 
+    {
+        std::lock_guard<std::mutex> lk(logMu);
+        stop = true;
+    }
+    stopCv.notify_one();
+    flusher.join();
+
+    rawLog.flush();
+    hourLog.flush();
+    dayLog.flush();
+
     std::cerr << "temp_logger finished (input closed)\n";
     return 0;
 }
@@ -1,10 +1,13 @@
-#include "agregator.hpp"
+#include "ingest_pipeline.hpp"
 #include "line_reader.hpp"
+#include "maintenance.hpp"
 #include "timeutil.hpp"
 
 #include "sqlite_db.hpp"
 #include "sqlite_repo.hpp"
+#include "sqlite_pool.hpp"
 #include "http.hpp"
+#include "tsdb_repo.hpp"
 
 #include <algorithm>
 #include <chrono>
@@ -13,15 +16,26 @@
 #include <memory>
 #include <string>
 #include <thread>
+#include <vector>
 
 
 static void usage() {
     std::cerr <<
       "temp_server:\n"
-      "  [--db temp.db]\n"
+      "  [--storage sqlite|tsdb] [--db temp.db|temp.tsdb]\n"
       "  --source stdin|serial [--port COM11|/dev/ttyUSB0] [--baud 9600]\n"
       "  [--http-host 127.0.0.1] [--http-port 8080]\n"
-      "  [--raw-keep-sec 86400] [--hour-keep-sec 2592000] [--compact-sec 300]\n";
+      "  [--raw-keep-sec 86400] [--1m-keep-sec 604800] [--5m-keep-sec 7776000]\n"
+      "  [--hour-keep-sec 2592000] [--compact-sec 300]\n"
+      "  [--retention-chunk 5000] [--checkpoint-sec 10]\n"
+      "  [--queue-cap 4096] [--overflow block|drop-oldest|spill] [--spill-cap 1048576]\n"
+      "  [--batch-size 256] [--batch-ms 200]\n"
+      "  [--read-mmap-mb 64] [--read-cache-kb 8192]\n"
+      "  [--page-size 4096] [--write-cache-kb 2000] [--temp-store default|file|memory]\n"
+      "  [--hot-window-sec 86400] [--hot-capacity 262144] (0 - off)\n"
+      "  [--stats-block-sec 60] (0 - off)\n"
+      "  [--rolling-windows 60,300,3600] (0 - off)\n"
+      "  [--sse-max 32] [--sse-buffer 64] (0 - off)\n";
 }
 
 
@@ -43,13 +57,9 @@ static bool parse_temp_line(const std::string& line, double& out) {
 }
 
 
-static std::int64_t to_unix(std::chrono::system_clock::time_point tp) {
-    return (std::int64_t)std::chrono::duration_cast<std::chrono::seconds>(tp.time_since_epoch()).count();
-}
-
-
 int main(int argc, char** argv) {
-    std::string dbPath = "temp.db";
+    std::string storage = "sqlite";
+    std::string dbPath;
 
     std::string source = "serial";
     std::string port;
@@ -58,9 +68,32 @@ int main(int argc, char** argv) {
     std::string http_host = "127.0.0.1";
     int http_port = 8080;
 
-    long long rawKeepSec  = 24 * 3600;
-    long long hourKeepSec = 30 * 24 * 3600;
-    long long compactSec  = 300;
+    IngestConfig ingest;
+    MaintenanceConfig maint;
+
+    // raw-окно в памяти для /api/current и свежих series/stats
+    long long hotWindowSec = 24 * 3600;
+    std::size_t hotCapacity = 262144;
+
+    // индекс блоков для stats по raw
+    long long statsBlockSec = 60;
+
+    // окна /api/rolling в секундах
+    std::vector<std::int64_t> rollingWindows = {60, 300, 3600};
+
+    // live-поток /api/stream: максимум подписчиков и очередь каждого (в пачках)
+    std::size_t sseMax = 32;
+    std::size_t sseBuffer = 64;
+
+    // pragma для read-only соединений HTTP
+    SqliteOptions readOpts;
+    readOpts.mmap_size  = 64LL * 1024 * 1024;
+    readOpts.cache_size = -8192;
+
+    // checkpoint WAL делает поток обслуживания, а не коммит писателя
+    SqliteOptions writeOpts;
+    writeOpts.wal_autocheckpoint = 0;
+    writeOpts.incremental_vacuum = true;
 
     for (int i = 1; i < argc; ++i) {
         std::string a = argv[i];
@@ -69,19 +102,65 @@ int main(int argc, char** argv) {
             return argv[++i];
         };
 
-        if (a == "--db") dbPath = need("--db");
+        if (a == "--storage") storage = need("--storage");
+        else if (a == "--db") dbPath = need("--db");
         else if (a == "--source") source = need("--source");
         else if (a == "--port") port = need("--port");
         else if (a == "--baud") baud = std::stoi(need("--baud"));
         else if (a == "--http-host") http_host = need("--http-host");
         else if (a == "--http-port") http_port = std::stoi(need("--http-port"));
-        else if (a == "--raw-keep-sec") rawKeepSec = std::stoll(need("--raw-keep-sec"));
-        else if (a == "--hour-keep-sec") hourKeepSec = std::stoll(need("--hour-keep-sec"));
-        else if (a == "--compact-sec") compactSec = std::stoll(need("--compact-sec"));
+        else if (a == "--raw-keep-sec") maint.raw_keep_sec = std::stoll(need("--raw-keep-sec"));
+        else if (a == "--1m-keep-sec") maint.m1_keep_sec = std::stoll(need("--1m-keep-sec"));
+        else if (a == "--5m-keep-sec") maint.m5_keep_sec = std::stoll(need("--5m-keep-sec"));
+        else if (a == "--hour-keep-sec") maint.hour_keep_sec = std::stoll(need("--hour-keep-sec"));
+        else if (a == "--compact-sec") maint.compact_sec = std::stoll(need("--compact-sec"));
+        else if (a == "--retention-chunk") maint.retention_chunk = std::stoi(need("--retention-chunk"));
+        else if (a == "--checkpoint-sec") maint.checkpoint_sec = std::stoll(need("--checkpoint-sec"));
+        else if (a == "--queue-cap") ingest.queue_cap = std::stoul(need("--queue-cap"));
+        else if (a == "--overflow") {
+            if (!parse_overflow_policy(need("--overflow"), ingest.overflow)) {
+                std::cerr << "Error: bad --overflow\n"; return 2;
+            }
+        }
+        else if (a == "--spill-cap") ingest.spill_cap = std::stoul(need("--spill-cap"));
+        else if (a == "--batch-size") ingest.batch_size = std::stoul(need("--batch-size"));
+        else if (a == "--batch-ms") ingest.batch_ms = std::chrono::milliseconds(std::stoll(need("--batch-ms")));
+        else if (a == "--read-mmap-mb") readOpts.mmap_size = std::stoll(need("--read-mmap-mb")) * 1024 * 1024;
+        else if (a == "--read-cache-kb") readOpts.cache_size = -std::stoi(need("--read-cache-kb"));
+        else if (a == "--page-size") writeOpts.page_size = std::stoi(need("--page-size"));
+        else if (a == "--write-cache-kb") writeOpts.cache_size = -std::stoi(need("--write-cache-kb"));
+        else if (a == "--temp-store") {
+            std::string v = need("--temp-store");
+            if (v == "default") writeOpts.temp_store = 0;
+            else if (v == "file") writeOpts.temp_store = 1;
+            else if (v == "memory") writeOpts.temp_store = 2;
+            else { std::cerr << "Error: bad --temp-store\n"; return 2; }
+            readOpts.temp_store = writeOpts.temp_store;
+        }
+        else if (a == "--hot-window-sec") hotWindowSec = std::stoll(need("--hot-window-sec"));
+        else if (a == "--hot-capacity") hotCapacity = std::stoul(need("--hot-capacity"));
+        else if (a == "--stats-block-sec") statsBlockSec = std::stoll(need("--stats-block-sec"));
+        else if (a == "--rolling-windows") {
+            rollingWindows.clear();
+            std::string v = need("--rolling-windows");
+            std::size_t pos = 0;
+            while (pos < v.size()) {
+                auto comma = v.find(',', pos);
+                if (comma == std::string::npos) comma = v.size();
+                long long w = std::stoll(v.substr(pos, comma - pos));
+                if (w > 0) rollingWindows.push_back(w);
+                pos = comma + 1;
+            }
+        }
+        else if (a == "--sse-max") sseMax = std::stoul(need("--sse-max"));
+        else if (a == "--sse-buffer") sseBuffer = std::stoul(need("--sse-buffer"));
         else if (a == "-h" || a == "--help") { usage(); return 0; }
         else { std::cerr << "Unknown arg: " << a << "\n"; usage(); return 2; }
     }
 
+    if (storage != "sqlite" && storage != "tsdb") { std::cerr << "Error: bad --storage\n"; return 2; }
+    if (dbPath.empty()) dbPath = storage == "tsdb" ? "temp.tsdb" : "temp.db";
+
     std::unique_ptr<LineReader> reader;
     if (source == "stdin") {
         reader = make_stdin_reader();
@@ -95,55 +174,88 @@ int main(int argc, char** argv) {
         return 2;
     }
 
-    SqliteDb db(dbPath);
-    SqliteRepo repo(db);
-    repo.init_schema();
-
-    // HTTP сервер поток
-    HttpSimple api(repo);
-    std::thread http_thr([&]{
-        api.run(http_host, http_port);
-    });
-
-    Aggregator hourAgg(timeutil::floor_to_hour);
-    Aggregator dayAgg(timeutil::floor_to_day);
-
-    using clock = std::chrono::system_clock;
-    auto nextCompact = clock::now() + std::chrono::seconds(compactSec);
-
-    std::cerr << "temp_server started. db=" << dbPath << "\n";
-
-    std::string line;
-    while (reader->readLine(line)) {
-        double temp = 0;
-        if (!parse_temp_line(line, temp)) continue;
-
-        auto now_tp = clock::now();
-        auto ts = to_unix(now_tp);
-
-        repo.insert_raw(ts, temp);
+    // tsdb: dbPath - каталог, sqlite-опции не используются
+    std::unique_ptr<SqliteDb> db;
+    std::unique_ptr<Repo> repoPtr;
+    std::unique_ptr<RepoReadPool> readPool;
+    if (storage == "tsdb") {
+        auto tsdb = std::make_unique<TsdbRepo>(dbPath);
+        readPool = std::make_unique<TsdbReadPool>(*tsdb);
+        repoPtr = std::move(tsdb);
+    } else {
+        db = std::make_unique<SqliteDb>(dbPath, writeOpts);
+        auto sqlite = std::make_unique<SqliteRepo>(*db);
+        sqlite->init_schema();
+        repoPtr = std::move(sqlite);
+    }
+    Repo& repo = *repoPtr;
+
+    IngestPipeline pipeline(repo, ingest);
+    pipeline.resume(std::chrono::system_clock::now());
+    maint.backlog = std::max<std::size_t>(ingest.batch_size, 1);
+    std::unique_ptr<Maintenance> maintPtr = db ? std::make_unique<Maintenance>(dbPath, pipeline, maint)
+                                               : std::make_unique<Maintenance>(repo, pipeline, maint);
+    Maintenance& maintenance = *maintPtr;
+    auto startUnix = timeutil::to_unix(std::chrono::system_clock::now());
+
+    // окно не может быть длиннее хранения raw в бд
+    std::unique_ptr<HotWindow> hot;
+    if (hotWindowSec > 0 && hotCapacity > 0) {
+        hot = std::make_unique<HotWindow>(std::min(hotWindowSec, maint.raw_keep_sec), hotCapacity);
+        hot->warm(repo, startUnix);
+        pipeline.add_observer(hot.get());
+    }
 
-        if (auto fin = hourAgg.push(now_tp, temp)) {
-            repo.insert_hourly(to_unix(fin->period_start), fin->avg);
-        }
+    std::unique_ptr<BlockStatsIndex> statsIndex;
+    if (statsBlockSec > 0) {
+        statsIndex = std::make_unique<BlockStatsIndex>(statsBlockSec, maint.raw_keep_sec);
+        statsIndex->warm(repo, startUnix);
+        pipeline.add_observer(statsIndex.get());
+        maintenance.add_observer(statsIndex.get());
+    }
 
-        if (auto fin = dayAgg.push(now_tp, temp)) {
-            repo.insert_daily(to_unix(fin->period_start), fin->avg);
-        }
+    std::unique_ptr<RollingStats> rolling;
+    if (!rollingWindows.empty()) {
+        rolling = std::make_unique<RollingStats>(rollingWindows);
+        rolling->warm(repo, startUnix);
+        pipeline.add_observer(rolling.get());
+    }
 
-        auto n = clock::now();
-        if (n >= nextCompact) {
-            auto now_unix = to_unix(n);
+    std::unique_ptr<Broadcaster> stream;
+    if (sseMax > 0) {
+        stream = std::make_unique<Broadcaster>(sseBuffer, sseMax);
+        pipeline.add_observer(stream.get());
+    }
 
-            repo.retention("raw", now_unix - rawKeepSec);
-            repo.retention("hourly", now_unix - hourKeepSec);
+    // поколения записи для ETag; последним, чтобы окно и индекс уже были обновлены
+    DataVersions versions((std::uint64_t)startUnix);
+    versions.warm(repo);
+    pipeline.add_observer(&versions);
+    maintenance.add_observer(&versions);
+
+    // HTTP сервер поток, у каждого потока своё read-only соединение
+    if (!readPool) readPool = std::make_unique<SqliteReadPool>(dbPath, readOpts);
+    HttpSources sources;
+    sources.ingest = &pipeline;
+    sources.hot = hot.get();
+    sources.index = statsIndex.get();
+    sources.versions = &versions;
+    sources.stream = stream.get();
+    sources.rolling = rolling.get();
+    HttpSimple api(*readPool, sources);
+    std::thread http_thr([&]{
+        api.run(http_host, http_port);
+    });
 
-            auto startYear = timeutil::start_of_current_year(n);
-            repo.retention("daily", to_unix(startYear));
+    std::cerr << "temp_server started. " << storage << "=" << dbPath << "\n";
 
-            nextCompact = n + std::chrono::seconds(compactSec);
-        }
-    }
+    // Запись в бд в своём потоке, чтение порта - в главном
+    std::thread writer_thr([&]{ pipeline.run_writer(); });
+    std::thread maint_thr([&]{ maintenance.run(); });
+    pipeline.run_reader(*reader, parse_temp_line);
+    writer_thr.join();
+    maintenance.stop();
+    maint_thr.join();
 
     std::cerr << "temp_server finished\n";
     std::exit(0);
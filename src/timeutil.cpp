@@ -1,7 +1,6 @@
 #include "timeutil.hpp"
+#include <algorithm>
 #include <ctime>
-#include <iomanip>
-#include <sstream>
 
 namespace timeutil {
 
@@ -15,42 +14,169 @@ static std::tm local_tm(std::time_t t) {
     return tm;
 }
 
-std::string format_iso_local(const TP& tp) {
+// Кэш текущего локального часа (на поток, без общей блокировки tz).
+// В [lo, hi) локальное время - это hour + (base + t - lo) секунд: переводы
+// часов попадают на границы часа, а hi не дальше lo + 3600.
+struct HourCache {
+    std::time_t lo = 1, hi = 0;          // пусто
+    std::time_t hour_start = 0, day_start = 0;
+    int year = 0, mon = 0, mday = 0, hour = 0;
+    int base = 0;                        // секунд от начала часа в момент lo
+};
+
+static HourCache& hour_cache() {
+    thread_local HourCache c;
+    return c;
+}
+
+static HourCache& hour_cache(std::time_t t) {
+    auto& c = hour_cache();
+    if (t >= c.lo && t < c.hi) return c;
+
+    std::tm tm = local_tm(t);
+    c.year = tm.tm_year + 1900;
+    c.mon  = tm.tm_mon + 1;
+    c.mday = tm.tm_mday;
+    c.hour = tm.tm_hour;
+
+    std::tm h = tm;
+    h.tm_min = 0;
+    h.tm_sec = 0;
+    c.hour_start = std::mktime(&h);
+
+    // mktime нормализует h, поэтому следующий час и день строим от tm
+    std::tm n = tm;
+    n.tm_min = 0;
+    n.tm_sec = 0;
+    n.tm_hour += 1;
+    n.tm_isdst = -1;
+    std::time_t next = std::mktime(&n);
+
+    std::tm d = tm;
+    d.tm_hour = 0;
+    d.tm_min = 0;
+    d.tm_sec = 0;
+    d.tm_isdst = -1;
+    c.day_start = std::mktime(&d);
+
+    if (t >= c.hour_start && next > t) {
+        c.lo = c.hour_start;
+        c.hi = std::min<std::time_t>(next, c.hour_start + 3600);
+        c.base = 0;
+    } else {
+        // необычная граница около перевода часов: кэшируем одну секунду
+        c.lo = t;
+        c.hi = t + 1;
+        c.base = tm.tm_min * 60 + tm.tm_sec;
+    }
+    return c;
+}
+
+static void put2(char* p, int v) {
+    p[0] = (char)('0' + v / 10);
+    p[1] = (char)('0' + v % 10);
+}
+
+void format_iso_local(const TP& tp, char* out) {
     auto t = std::chrono::system_clock::to_time_t(tp);
-    auto tm = local_tm(t);
-    std::ostringstream oss;
-    oss << std::put_time(&tm, "%Y-%m-%dT%H:%M:%S");
-    return oss.str();
+    const auto& c = hour_cache(t);
+    int secs = c.base + (int)(t - c.lo);
+
+    int y = c.year;
+    out[0] = (char)('0' + y / 1000 % 10);
+    out[1] = (char)('0' + y / 100 % 10);
+    put2(out + 2, y % 100);
+    out[4] = '-';
+    put2(out + 5, c.mon);
+    out[7] = '-';
+    put2(out + 8, c.mday);
+    out[10] = 'T';
+    put2(out + 11, c.hour);
+    out[13] = ':';
+    put2(out + 14, secs / 60);
+    out[16] = ':';
+    put2(out + 17, secs % 60);
 }
 
-bool parse_iso_local(const std::string& s, TP& out) {
+std::string format_iso_local(const TP& tp) {
+    char buf[kIsoLen];
+    format_iso_local(tp, buf);
+    return std::string(buf, kIsoLen);
+}
+
+static bool digits(const char* p, int n, int& out) {
+    int v = 0;
+    for (int i = 0; i < n; ++i) {
+        if (p[i] < '0' || p[i] > '9') return false;
+        v = v * 10 + (p[i] - '0');
+    }
+    out = v;
+    return true;
+}
+
+bool parse_iso_local(const char* s, std::size_t n, TP& out) {
+    if (n != kIsoLen || s[4] != '-' || s[7] != '-' || s[10] != 'T' || s[13] != ':' || s[16] != ':')
+        return false;
+
+    int y, mo, d, h, mi, se;
+    if (!digits(s, 4, y) || !digits(s + 5, 2, mo) || !digits(s + 8, 2, d) ||
+        !digits(s + 11, 2, h) || !digits(s + 14, 2, mi) || !digits(s + 17, 2, se))
+        return false;
+    if (mo < 1 || mo > 12 || d < 1 || d > 31 || h > 23 || mi > 59 || se > 60) return false;
+
+    // тот же час, что в кэше: без mktime. В повторяющемся при переводе
+    // часов часе это то вхождение, которое сейчас в кэше (идущие подряд
+    // строки лога остаются по возрастанию)
+    const auto& c = hour_cache();
+    if (c.lo < c.hi && c.base == 0 && c.year == y && c.mon == mo && c.mday == d && c.hour == h) {
+        out = std::chrono::system_clock::from_time_t(c.lo + mi * 60 + se);
+        return true;
+    }
+
     std::tm tm{};
-    std::istringstream iss(s);
-    iss >> std::get_time(&tm, "%Y-%m-%dT%H:%M:%S");
-    if (iss.fail()) return false;
+    tm.tm_year = y - 1900;
+    tm.tm_mon  = mo - 1;
+    tm.tm_mday = d;
+    tm.tm_hour = h;
+    tm.tm_min  = mi;
+    tm.tm_sec  = se;
+    tm.tm_isdst = -1;
 
     std::time_t t = std::mktime(&tm); // local time
     if (t == (std::time_t)-1) return false;
 
+    hour_cache(t);
     out = std::chrono::system_clock::from_time_t(t);
     return true;
 }
 
+bool parse_iso_local(const std::string& s, TP& out) {
+    return parse_iso_local(s.data(), s.size(), out);
+}
+
+// Смещения поясов кратны 15 минутам, поэтому минуты и 5 минут режем без localtime
+TP floor_to_minute(const TP& tp) {
+    return std::chrono::floor<std::chrono::minutes>(tp);
+}
+
+TP floor_to_5min(const TP& tp) {
+    auto m = std::chrono::floor<std::chrono::minutes>(tp).time_since_epoch().count();
+    m -= ((m % 5) + 5) % 5;
+    return TP(std::chrono::minutes(m));
+}
+
 TP floor_to_hour(const TP& tp) {
     auto t = std::chrono::system_clock::to_time_t(tp);
-    auto tm = local_tm(t);
-    tm.tm_min = 0;
-    tm.tm_sec = 0;
-    return std::chrono::system_clock::from_time_t(std::mktime(&tm));
+    return std::chrono::system_clock::from_time_t(hour_cache(t).hour_start);
 }
 
 TP floor_to_day(const TP& tp) {
     auto t = std::chrono::system_clock::to_time_t(tp);
-    auto tm = local_tm(t);
-    tm.tm_hour = 0;
-    tm.tm_min  = 0;
-    tm.tm_sec  = 0;
-    return std::chrono::system_clock::from_time_t(std::mktime(&tm));
+    return std::chrono::system_clock::from_time_t(hour_cache(t).day_start);
+}
+
+std::int64_t to_unix(const TP& tp) {
+    return (std::int64_t)std::chrono::duration_cast<std::chrono::seconds>(tp.time_since_epoch()).count();
 }
 
 TP start_of_current_year(const TP& now) {
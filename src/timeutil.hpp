@@ -1,20 +1,36 @@
 #pragma once
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <string>
 
 namespace timeutil {
 using TP = std::chrono::system_clock::time_point;
 
+// Длина "YYYY-MM-DDTHH:MM:SS"
+constexpr std::size_t kIsoLen = 19;
+
 // Форматирование времени в локальном времени: "YYYY-MM-DDTHH:MM:SS"
 std::string format_iso_local(const TP& tp);
+// То же в буфер без выделения памяти; пишет ровно kIsoLen символов, без '\0'
+void format_iso_local(const TP& tp, char* out);
 
 // Парсинг ISO локального времени
 bool parse_iso_local(const std::string& s, TP& out);
+// Строгий разбор ровно kIsoLen символов, без выделения памяти
+bool parse_iso_local(const char* s, std::size_t n, TP& out);
 
-// Округление времени к началу часа/дня
+// Округление времени к началу минуты/5 минут/часа/дня.
+// Час и день берутся из кэша границ текущего часа (на поток); localtime/mktime
+// вызываются, только когда время вышло за кэшированный час.
+TP floor_to_minute(const TP& tp);
+TP floor_to_5min(const TP& tp);
 TP floor_to_hour(const TP& tp);
 TP floor_to_day(const TP& tp);
 
+// Unix-время в секундах
+std::int64_t to_unix(const TP& tp);
+
 // 1 января текущего года
 TP start_of_current_year(const TP& now);
 } // namespace timeutil
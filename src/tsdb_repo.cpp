@@ -0,0 +1,839 @@
+#include "tsdb_repo.hpp"
+#include "gorilla.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <stdexcept>
+
+namespace fs = std::filesystem;
+
+// Длина сегмента и блока по kind (порядок Repo::kinds())
+struct TsdbKind {
+    std::int64_t seg_sec;
+    std::size_t block_records;
+};
+
+static const TsdbKind kTsdbKinds[Repo::kKindCount] = {
+    {24 * 3600,       1024},   // raw
+    {7 * 24 * 3600,   1024},   // 1m
+    {30 * 24 * 3600,  1024},   // 5m
+    {30 * 24 * 3600,  256},    // hourly, со скетчами
+    {365 * 24 * 3600, 64},     // daily, со скетчами
+};
+
+// Блок в .seg, всё little-endian:
+//   "TSB1" | u32 n | u32 длина данных | u32 CRC32 данных | u32 flags | u32 0 |
+//   i64 min_ts | i64 max_ts | i64 count | f64 sum | f64 min | f64 max | данные
+// данные: по колонке u32 длина + поток Gorilla (ts, значение); у hourly/daily
+// затем по записи u32 длина + скетч. flags: бит c - колонка c хранится * 1000,
+// kUnsorted - записи внутри блока не по порядку ts.
+static const char kBlockMagic[4] = {'T', 'S', 'B', '1'};
+static constexpr std::size_t kBlockHeader = 72;
+static constexpr std::uint32_t kUnsorted = 1u << 8;
+
+// .tail: "TST1" | u32 0 | u64 длина .seg, когда tail начат | записи
+//   raw:     i64 ts | f64 value
+//   свёртка: i64 ts | i64 count | f64 sum | f64 min | f64 max | u32 длина + скетч
+// Если .seg длиннее - блок из этих записей уже дописан, а tail не успели обнулить.
+static const char kTailMagic[4] = {'T', 'S', 'T', '1'};
+static constexpr std::size_t kTailHeader = 16;
+
+// open.N: "TSO1" | u32 длина | u32 CRC32 (seq + записи) | u64 seq | записи
+//   u8 kind | i64 ts | i64 count | f64 sum | f64 min | f64 max | u32 длина + скетч
+// Пишется в файл старшего seq по очереди: при обрыве остаётся предыдущий.
+static const char kOpenMagic[4] = {'T', 'S', 'O', '1'};
+static constexpr std::size_t kOpenHeader = 20;
+
+static void put_u32(std::string& out, std::uint32_t v) {
+    for (int i = 0; i < 4; ++i) out.push_back((char)((v >> (8 * i)) & 0xff));
+}
+
+static void put_u64(std::string& out, std::uint64_t v) {
+    for (int i = 0; i < 8; ++i) out.push_back((char)((v >> (8 * i)) & 0xff));
+}
+
+static void put_f64(std::string& out, double v) {
+    std::uint64_t u;
+    std::memcpy(&u, &v, sizeof(u));
+    put_u64(out, u);
+}
+
+static std::uint64_t get_le(const char* p, int n) {
+    std::uint64_t v = 0;
+    for (int i = 0; i < n; ++i) v |= (std::uint64_t)(unsigned char)p[i] << (8 * i);
+    return v;
+}
+
+static double get_f64(const char* p) {
+    std::uint64_t u = get_le(p, 8);
+    double v;
+    std::memcpy(&v, &u, sizeof(v));
+    return v;
+}
+
+static int column_count(int k) {
+    return k == 0 ? 1 : 4;
+}
+
+static double column(int k, const DbRollup& r, int c) {
+    if (k == 0) return r.sum;
+    switch (c) {
+        case 0: return (double)r.count;
+        case 1: return r.sum;
+        case 2: return r.min;
+        default: return r.max;
+    }
+}
+
+static void set_column(int k, DbRollup& r, int c, double v) {
+    if (k == 0) {
+        r.count = 1;
+        r.sum = r.min = r.max = v;
+        return;
+    }
+    switch (c) {
+        case 0: r.count = (long long)v; break;
+        case 1: r.sum = v; break;
+        case 2: r.min = v; break;
+        default: r.max = v; break;
+    }
+}
+
+static DbRollup from_point(std::int64_t ts, double v) {
+    return DbRollup{ts, 1, v, v, v};
+}
+
+// Свёртки одного периода, записанные несколько раз
+static void merge_rollup(DbRollup& a, const DbRollup& b) {
+    a.count += b.count;
+    a.sum += b.sum;
+    a.min = std::min(a.min, b.min);
+    a.max = std::max(a.max, b.max);
+}
+
+static void encode_tail(int k, const DbRollup& r, std::string& out) {
+    put_u64(out, (std::uint64_t)r.ts);
+    if (k == 0) {
+        put_f64(out, r.sum);
+        return;
+    }
+    put_u64(out, (std::uint64_t)r.count);
+    put_f64(out, r.sum);
+    put_f64(out, r.min);
+    put_f64(out, r.max);
+    put_u32(out, (std::uint32_t)r.sketch.size());
+    out += r.sketch;
+}
+
+// Целые записи из [p, end) в out, не больше max_records (-1 - все); сколько байт занимают
+static std::size_t decode_tail(int k, const char* p, const char* end, std::vector<DbRollup>& out,
+                               int max_records = -1) {
+    const char* start = p;
+    for (int i = 0; p < end && i != max_records; ++i) {
+        if (k == 0) {
+            if (end - p < 16) break;
+            out.push_back(from_point((std::int64_t)get_le(p, 8), get_f64(p + 8)));
+            p += 16;
+            continue;
+        }
+        if (end - p < 44) break;
+        std::size_t len = (std::size_t)get_le(p + 40, 4);
+        if ((std::size_t)(end - p) < 44 + len) break;
+        DbRollup r{(std::int64_t)get_le(p, 8), (long long)get_le(p + 8, 8), get_f64(p + 16), get_f64(p + 24),
+                   get_f64(p + 32)};
+        r.sketch.assign(p + 44, len);
+        out.push_back(std::move(r));
+        p += 44 + len;
+    }
+    return (std::size_t)(p - start);
+}
+
+// Колонка, где все значения целые, хранится как есть; где все в тысячных - * 1000
+static std::string encode_block(int k, const std::vector<DbRollup>& recs) {
+    std::string data;
+    std::uint32_t flags = 0;
+
+    for (int c = 0; c < column_count(k); ++c) {
+        bool integral = true, milli = true;
+        for (const auto& r : recs) {
+            double v = column(k, r, c), m;
+            if (integral && !(v == std::trunc(v) && std::fabs(v) < 9007199254740992.0)) integral = false;
+            if (milli && !gorilla_to_milli(v, m)) milli = false;
+            if (!integral && !milli) break;
+        }
+        bool scaled = !integral && milli;
+
+        GorillaEncoder enc;
+        for (const auto& r : recs) {
+            double v = column(k, r, c);
+            if (scaled) gorilla_to_milli(v, v);
+            enc.append(r.ts, v);
+        }
+        if (scaled) flags |= 1u << c;
+        put_u32(data, (std::uint32_t)enc.bytes().size());
+        data.append((const char*)enc.bytes().data(), enc.bytes().size());
+    }
+    if (Repo::has_sketch(Repo::kinds()[k])) {
+        for (const auto& r : recs) {
+            put_u32(data, (std::uint32_t)r.sketch.size());
+            data += r.sketch;
+        }
+    }
+
+    DbRollup agg = recs.front();
+    std::int64_t mn = recs.front().ts, mx = mn;
+    for (std::size_t i = 1; i < recs.size(); ++i) {
+        if (recs[i].ts < recs[i - 1].ts) flags |= kUnsorted;
+        mn = std::min(mn, recs[i].ts);
+        mx = std::max(mx, recs[i].ts);
+        merge_rollup(agg, recs[i]);
+    }
+
+    std::string out(kBlockMagic, sizeof(kBlockMagic));
+    out.reserve(kBlockHeader + data.size());
+    put_u32(out, (std::uint32_t)recs.size());
+    put_u32(out, (std::uint32_t)data.size());
+    put_u32(out, crc32(data.data(), data.size()));
+    put_u32(out, flags);
+    put_u32(out, 0);
+    put_u64(out, (std::uint64_t)mn);
+    put_u64(out, (std::uint64_t)mx);
+    put_u64(out, (std::uint64_t)agg.count);
+    put_f64(out, agg.sum);
+    put_f64(out, agg.min);
+    put_f64(out, agg.max);
+    out += data;
+    return out;
+}
+
+TsdbRepo::Segment::Segment(std::int64_t s) : start(s), tail_out(LogWriterConfig{64 * 1024, -1, SyncPolicy::Flush}) {}
+
+TsdbRepo::TsdbRepo(std::string dir) : m_dir(std::move(dir)) {
+    for (int k = 0; k < kKindCount; ++k) {
+        std::error_code ec;
+        fs::create_directories(kind_dir(k), ec);
+        if (ec) throw std::runtime_error("tsdb: can't create " + kind_dir(k));
+        load_kind(k);
+    }
+    load_open();
+}
+
+std::string TsdbRepo::kind_dir(int k) const {
+    return (fs::path(m_dir) / kinds()[k]).string();
+}
+
+std::string TsdbRepo::seg_path(int k, std::int64_t start, const char* ext) const {
+    return (fs::path(kind_dir(k)) / (std::to_string(start) + ext)).string();
+}
+
+std::int64_t TsdbRepo::seg_start(int k, std::int64_t ts) {
+    std::int64_t len = kTsdbKinds[k].seg_sec;
+    std::int64_t q = ts / len;
+    if (ts % len < 0) --q;
+    return q * len;
+}
+
+// Сегменты kind и граница retention
+void TsdbRepo::load_kind(int k) {
+    Series& ser = m_series[k];
+
+    {
+        std::ifstream in(fs::path(kind_dir(k)) / "floor");
+        long long floor;
+        if (in >> floor) ser.floor = floor;
+    }
+
+    std::error_code ec;
+    for (fs::directory_iterator it(kind_dir(k), ec), end; !ec && it != end; it.increment(ec)) {
+        const std::string ext = it->path().extension().string();
+        if (ext != ".seg" && ext != ".tail") continue;
+
+        const std::string stem = it->path().stem().string();
+        char* numEnd = nullptr;
+        long long start = std::strtoll(stem.c_str(), &numEnd, 10);
+        if (stem.empty() || *numEnd != '\0' || seg_start(k, start) != start) continue;
+        if (!ser.segs.count(start)) ser.segs.emplace(start, std::make_unique<Segment>(start));
+    }
+
+    for (auto& kv : ser.segs) load_segment(k, *kv.second);
+}
+
+// Блоки .seg по заголовкам; оборванный или битый хвост обрезается. Потом .tail
+void TsdbRepo::load_segment(int k, Segment& s) {
+    const std::string path = seg_path(k, s.start, ".seg");
+    std::error_code ec;
+
+    if (fs::exists(path, ec)) {
+        s.map = std::make_unique<MappedFile>(path);
+        const char* base = s.map->data();
+        std::size_t size = s.map->size();
+
+        std::uint64_t off = 0;
+        while (off + kBlockHeader <= size) {
+            const char* h = base + off;
+            std::size_t bytes = (std::size_t)get_le(h + 8, 4);
+            if (std::memcmp(h, kBlockMagic, sizeof(kBlockMagic)) != 0 || bytes > size - off - kBlockHeader ||
+                crc32(h + kBlockHeader, bytes) != (std::uint32_t)get_le(h + 12, 4))
+                break;
+
+            Block b;
+            b.offset = off;
+            b.n = (std::uint32_t)get_le(h + 4, 4);
+            b.flags = (std::uint32_t)get_le(h + 16, 4);
+            b.min_ts = (std::int64_t)get_le(h + 24, 8);
+            b.max_ts = (std::int64_t)get_le(h + 32, 8);
+            b.count = (long long)get_le(h + 40, 8);
+            b.sum = get_f64(h + 48);
+            b.min = get_f64(h + 56);
+            b.max = get_f64(h + 64);
+
+            if ((b.flags & kUnsorted) || b.min_ts < s.last_ts) s.sorted = false;
+            s.last_ts = std::max(s.last_ts, b.max_ts);
+            s.blocks.push_back(b);
+            off += kBlockHeader + bytes;
+        }
+        s.seg_bytes = off;
+
+        if (off < size) {
+            s.map.reset();
+            fs::resize_file(path, off, ec);
+            s.map = std::make_unique<MappedFile>(path);
+        }
+    }
+
+    const std::string tpath = seg_path(k, s.start, ".tail");
+    if (!fs::exists(tpath, ec)) return;
+
+    bool keep = false;
+    std::uint64_t valid = kTailHeader;
+    {
+        MappedFile t(tpath);
+        if (t.ok() && t.size() >= kTailHeader && std::memcmp(t.data(), kTailMagic, sizeof(kTailMagic)) == 0 &&
+            get_le(t.data() + 8, 8) >= s.seg_bytes) {
+            keep = true;
+            valid += decode_tail(k, t.data() + kTailHeader, t.data() + t.size(), s.tail);
+            if (valid < t.size()) fs::resize_file(tpath, valid, ec);
+        }
+    }
+    if (!keep) {
+        // записи уже в последнем блоке или файл пустой
+        reset_tail(k, s);
+        return;
+    }
+
+    for (const auto& r : s.tail) {
+        if (r.ts < s.last_ts) s.sorted = false;
+        s.last_ts = r.ts;
+    }
+}
+
+// Из двух слотов берётся целый со старшим seq
+void TsdbRepo::load_open() {
+    for (int slot = 0; slot < 2; ++slot) {
+        const std::string path = (fs::path(m_dir) / ("open." + std::to_string(slot))).string();
+        std::error_code ec;
+        if (!fs::exists(path, ec)) continue;
+
+        MappedFile f(path);
+        if (!f.ok() || f.size() < kOpenHeader || std::memcmp(f.data(), kOpenMagic, sizeof(kOpenMagic)) != 0)
+            continue;
+        std::size_t len = (std::size_t)get_le(f.data() + 4, 4);
+        if (len != f.size() - kOpenHeader) continue;
+        if (crc32(f.data() + 12, len + 8) != (std::uint32_t)get_le(f.data() + 8, 4)) continue;
+
+        std::uint64_t seq = get_le(f.data() + 12, 8);
+        if (seq <= m_open_seq && m_open_seq != 0) continue;
+
+        std::optional<DbRollup> open[kKindCount];
+        const char* p = f.data() + kOpenHeader;
+        const char* end = f.data() + f.size();
+        bool ok = true;
+        while (p < end) {
+            int k = (unsigned char)*p;
+            std::vector<DbRollup> one;
+            std::size_t n = decode_tail(1, p + 1, end, one, 1);
+            if (k <= 0 || k >= kKindCount || n == 0) { ok = false; break; }
+            open[k] = std::move(one.front());
+            p += 1 + n;
+        }
+        if (!ok) continue;
+
+        m_open_seq = seq;
+        for (int k = 0; k < kKindCount; ++k) m_open[k] = std::move(open[k]);
+    }
+}
+
+// Пачка пишет open целиком в слот, который сейчас не последний
+void TsdbRepo::write_open() {
+    std::string body;
+    put_u64(body, ++m_open_seq);
+    for (int k = 1; k < kKindCount; ++k) {
+        if (!m_open[k]) continue;
+        body.push_back((char)k);
+        encode_tail(k, *m_open[k], body);
+    }
+
+    std::string out(kOpenMagic, sizeof(kOpenMagic));
+    put_u32(out, (std::uint32_t)(body.size() - 8));
+    put_u32(out, crc32(body.data(), body.size()));
+    out += body;
+
+    const std::string path = (fs::path(m_dir) / ("open." + std::to_string(m_open_seq % 2))).string();
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    f.write(out.data(), (std::streamsize)out.size());
+}
+
+void TsdbRepo::write_floor(int k) {
+    fs::path p = fs::path(kind_dir(k)) / "floor";
+    fs::path tmp = p;
+    tmp += ".tmp";
+    {
+        std::ofstream out(tmp);
+        out << m_series[k].floor << "\n";
+    }
+    std::error_code ec;
+    fs::rename(tmp, p, ec);
+}
+
+// Пустой .tail с текущей длиной .seg
+void TsdbRepo::reset_tail(int k, Segment& s) {
+    s.tail_out.close();
+    std::string h(kTailMagic, sizeof(kTailMagic));
+    put_u32(h, 0);
+    put_u64(h, s.seg_bytes);
+    std::ofstream out(seg_path(k, s.start, ".tail"), std::ios::binary | std::ios::trunc);
+    out.write(h.data(), (std::streamsize)h.size());
+}
+
+// Новый сегмент: запись ушла вперёд, открытые блоки прежних закрываем
+TsdbRepo::Segment& TsdbRepo::segment_for_write(int k, std::int64_t ts) {
+    auto& segs = m_series[k].segs;
+    std::int64_t start = seg_start(k, ts);
+    auto it = segs.find(start);
+    if (it != segs.end()) return *it->second;
+
+    for (auto& kv : segs) {
+        if (kv.first > start) break;
+        if (!kv.second->tail.empty()) seal(k, *kv.second);
+        kv.second->tail_out.close();
+    }
+
+    auto seg = std::make_unique<Segment>(start);
+    reset_tail(k, *seg);
+    Segment& s = *seg;
+    std::unique_lock<std::shared_mutex> lk(m_mu);
+    segs.emplace(start, std::move(seg));
+    return s;
+}
+
+void TsdbRepo::append(int k, const DbRollup& r, std::vector<Segment*>& touched) {
+    Segment& s = segment_for_write(k, r.ts);
+    if (!s.tail_out.is_open()) s.tail_out.open(seg_path(k, s.start, ".tail"));
+
+    std::string buf;
+    encode_tail(k, r, buf);
+    s.tail_out.write(buf.data(), buf.size());
+    if (std::find(touched.begin(), touched.end(), &s) == touched.end()) touched.push_back(&s);
+
+    {
+        std::unique_lock<std::shared_mutex> lk(m_mu);
+        if (r.ts < s.last_ts) s.sorted = false;
+        s.last_ts = r.ts;
+        s.tail.push_back(r);
+    }
+
+    if (s.tail.size() >= kTsdbKinds[k].block_records) seal(k, s);
+}
+
+// Открытый блок -> .seg (с fdatasync: он должен лечь на диск раньше, чем обнулится .tail).
+// Запись и fdatasync - до m_mu: читатели до подмены видят те же записи в tail
+void TsdbRepo::seal(int k, Segment& s) {
+    if (s.tail.empty()) return;
+
+    const std::string path = seg_path(k, s.start, ".seg");
+    std::string block = encode_block(k, s.tail);
+    {
+        LogWriter out(LogWriterConfig{0, 0, SyncPolicy::Flush});
+        if (!out.open(path)) throw std::runtime_error("tsdb: can't open " + path);
+        out.write(block.data(), block.size());
+        out.sync();
+    }
+
+    Block b;
+    b.offset = s.seg_bytes;
+    const char* h = block.data();
+    b.n = (std::uint32_t)get_le(h + 4, 4);
+    b.flags = (std::uint32_t)get_le(h + 16, 4);
+    b.min_ts = (std::int64_t)get_le(h + 24, 8);
+    b.max_ts = (std::int64_t)get_le(h + 32, 8);
+    b.count = (long long)get_le(h + 40, 8);
+    b.sum = get_f64(h + 48);
+    b.min = get_f64(h + 56);
+    b.max = get_f64(h + 64);
+
+    // отображение видит только старый размер; старое живёт, пока его держат снимки
+    std::shared_ptr<const MappedFile> map = std::make_shared<MappedFile>(path);
+    {
+        std::unique_lock<std::shared_mutex> lk(m_mu);
+        s.blocks.push_back(b);
+        s.map = std::move(map);
+        s.tail.clear();
+    }
+    s.seg_bytes += block.size();
+    reset_tail(k, s);
+}
+
+void TsdbRepo::write_batch(const DbBatch& b) {
+    if (b.empty() && b.open.empty()) return;
+    std::lock_guard<std::mutex> wl(m_write_mu);
+
+    std::vector<Segment*> touched;
+    for (const auto& p : b.raw) append(0, from_point(p.ts, p.value), touched);
+    for (int k = 1; k < kKindCount; ++k) {
+        for (const auto& r : *b.rollups(kinds()[k])) append(k, r, touched);
+    }
+    // одна запись в .tail на сегмент
+    for (auto* s : touched) s->tail_out.flush();
+
+    if (!b.open.empty()) {
+        {
+            std::unique_lock<std::shared_mutex> lk(m_mu);
+            for (const auto& o : b.open) m_open[kind_index(o.first)] = o.second;
+        }
+        write_open();
+    }
+}
+
+void TsdbRepo::insert_raw(std::int64_t ts, double v) {
+    DbBatch b;
+    b.raw.push_back({ts, v});
+    write_batch(b);
+}
+
+void TsdbRepo::insert_raw_batch(const std::vector<DbPoint>& pts) {
+    DbBatch b;
+    b.raw = pts;
+    write_batch(b);
+}
+
+void TsdbRepo::insert_rollup(const std::string& kind, const DbRollup& r) {
+    int k = kind_index(kind);
+    if (step_sec(kind) == 0) throw std::runtime_error("wrong kind");
+
+    std::lock_guard<std::mutex> wl(m_write_mu);
+    std::vector<Segment*> touched;
+    append(k, r, touched);
+    for (auto* s : touched) s->tail_out.flush();
+}
+
+std::optional<DbRollup> TsdbRepo::open_period(const std::string& kind) {
+    int k = kind_index(kind);
+    std::shared_lock<std::shared_mutex> lk(m_mu);
+    return m_open[k];
+}
+
+bool TsdbRepo::decode_block(int k, const MappedFile& map, const Block& b, std::vector<DbRollup>& out) {
+    if (b.offset + kBlockHeader > map.size()) return false;
+    const char* p = map.data() + b.offset + kBlockHeader;
+    const char* end = p + get_le(p - kBlockHeader + 8, 4);
+    if ((std::size_t)(end - map.data()) > map.size()) return false;
+
+    std::size_t base = out.size();
+    out.resize(base + b.n, DbRollup{0, 0, 0, 0, 0});
+    for (int c = 0; c < column_count(k); ++c) {
+        if (end - p < 4) return false;
+        std::size_t len = (std::size_t)get_le(p, 4);
+        p += 4;
+        if ((std::size_t)(end - p) < len) return false;
+
+        GorillaDecoder dec((const std::uint8_t*)p, len, b.n);
+        bool scaled = b.flags & (1u << c);
+        for (std::uint32_t i = 0; i < b.n; ++i) {
+            std::int64_t ts;
+            double v;
+            if (!dec.next(ts, v)) return false;
+            if (scaled) v /= 1000.0;
+            if (c == 0) out[base + i].ts = ts;
+            set_column(k, out[base + i], c, v);
+        }
+        p += len;
+    }
+    if (has_sketch(kinds()[k])) {
+        for (std::uint32_t i = 0; i < b.n; ++i) {
+            if (end - p < 4) return false;
+            std::size_t len = (std::size_t)get_le(p, 4);
+            if ((std::size_t)(end - p - 4) < len) return false;
+            out[base + i].sketch.assign(p + 4, len);
+            p += 4 + len;
+        }
+    }
+    return true;
+}
+
+// Под m_mu: копируются только заголовки блоков и записи tail из периода
+std::vector<TsdbRepo::SegView> TsdbRepo::snapshot(int k, std::int64_t& from, std::int64_t to) const {
+    std::vector<SegView> views;
+    const Series& ser = m_series[k];
+    from = std::max(from, ser.floor);
+    if (from > to || ser.segs.empty()) return views;
+
+    auto it = from > ser.segs.begin()->first ? ser.segs.upper_bound(seg_start(k, from) - 1) : ser.segs.begin();
+    for (; it != ser.segs.end() && it->first <= to; ++it) {
+        const Segment& s = *it->second;
+        SegView v;
+        v.map = s.map;
+        v.sorted = s.sorted;
+
+        // у упорядоченного сегмента первый нужный блок - двоичным поиском по max_ts
+        auto b = s.sorted ? std::partition_point(s.blocks.begin(), s.blocks.end(),
+                                                 [&](const Block& x) { return x.max_ts < from; })
+                          : s.blocks.begin();
+        for (; b != s.blocks.end(); ++b) {
+            if (b->min_ts > to) {
+                if (s.sorted) break;
+                continue;
+            }
+            if (b->max_ts >= from) v.blocks.push_back(*b);
+        }
+        for (const auto& r : s.tail) {
+            if (r.ts >= from && r.ts <= to) v.tail.push_back(r);
+        }
+        if (!v.blocks.empty() || !v.tail.empty()) views.push_back(std::move(v));
+    }
+    return views;
+}
+
+// Без блокировок: всё нужное уже в снимке
+void TsdbRepo::scan(int k, std::int64_t from, std::int64_t to,
+                    const std::function<bool(const DbRollup&)>& fn) const {
+    std::vector<SegView> views;
+    {
+        std::shared_lock<std::shared_mutex> lk(m_mu);
+        views = snapshot(k, from, to);
+    }
+
+    std::vector<DbRollup> recs;
+    for (const auto& v : views) {
+        recs.clear();
+
+        if (v.sorted) {
+            for (const auto& b : v.blocks) {
+                recs.clear();
+                if (v.map) decode_block(k, *v.map, b, recs);
+                for (const auto& r : recs) {
+                    if (r.ts < from) continue;
+                    if (r.ts > to) return;
+                    if (!fn(r)) return;
+                }
+            }
+            for (const auto& r : v.tail) {
+                if (!fn(r)) return;
+            }
+            continue;
+        }
+
+        // часы переводили назад: сегмент собираем и сортируем целиком
+        for (const auto& b : v.blocks) {
+            if (v.map) decode_block(k, *v.map, b, recs);
+        }
+        recs.erase(std::remove_if(recs.begin(), recs.end(),
+                                  [&](const DbRollup& r) { return r.ts < from || r.ts > to; }),
+                   recs.end());
+        recs.insert(recs.end(), v.tail.begin(), v.tail.end());
+        std::stable_sort(recs.begin(), recs.end(),
+                         [](const DbRollup& a, const DbRollup& b) { return a.ts < b.ts; });
+        for (const auto& r : recs) {
+            if (!fn(r)) return;
+        }
+    }
+}
+
+std::optional<std::int64_t> TsdbRepo::seg_max(const Segment& s) const {
+    std::optional<std::int64_t> mx;
+    for (const auto& b : s.blocks) mx = std::max(mx.value_or(b.max_ts), b.max_ts);
+    for (const auto& r : s.tail) mx = std::max(mx.value_or(r.ts), r.ts);
+    return mx;
+}
+
+std::optional<DbPoint> TsdbRepo::latest_raw() {
+    auto mx = max_ts("raw");
+    if (!mx) return std::nullopt;
+
+    // последняя из записей с самым новым ts, как ORDER BY ts DESC у sqlite
+    std::optional<DbPoint> p;
+    scan(0, *mx, *mx, [&](const DbRollup& r) { p = DbPoint{r.ts, r.sum}; return true; });
+    return p;
+}
+
+std::optional<std::int64_t> TsdbRepo::max_ts(const std::string& kind) {
+    int k = kind_index(kind);
+    std::shared_lock<std::shared_mutex> lk(m_mu);
+    const auto& segs = m_series[k].segs;
+
+    // сегменты по времени: первый непустой с конца и есть самый новый
+    for (auto it = segs.rbegin(); it != segs.rend(); ++it) {
+        auto mx = seg_max(*it->second);
+        if (!mx) continue;
+        if (*mx < m_series[k].floor) break;
+        return mx;
+    }
+    return std::nullopt;
+}
+
+std::optional<std::int64_t> TsdbRepo::min_ts(const std::string& kind) {
+    int k = kind_index(kind);
+    std::optional<std::int64_t> mn;
+    scan(k, INT64_MIN, INT64_MAX, [&](const DbRollup& r) { mn = r.ts; return false; });
+    return mn;
+}
+
+// Блоки целиком внутри периода - из заголовка, пограничные расжимаются
+DbStats TsdbRepo::stats(const std::string& kind, std::int64_t from, std::int64_t to) {
+    int k = kind_index(kind);
+    std::vector<SegView> views;
+    {
+        std::shared_lock<std::shared_mutex> lk(m_mu);
+        views = snapshot(k, from, to);
+    }
+
+    DbStats s{};
+    double sum = 0;
+    auto add = [&](long long count, double sm, double mn, double mx) {
+        if (count <= 0) return;
+        if (s.count == 0) { s.min = mn; s.max = mx; }
+        else { s.min = std::min(s.min, mn); s.max = std::max(s.max, mx); }
+        s.count += count;
+        sum += sm;
+    };
+
+    std::vector<DbRollup> recs;
+    for (const auto& v : views) {
+        for (const auto& b : v.blocks) {
+            if (b.min_ts >= from && b.max_ts <= to) {
+                add(b.count, b.sum, b.min, b.max);
+                continue;
+            }
+            recs.clear();
+            if (v.map) decode_block(k, *v.map, b, recs);
+            for (const auto& r : recs) {
+                if (r.ts >= from && r.ts <= to) add(r.count, r.sum, r.min, r.max);
+            }
+        }
+        for (const auto& r : v.tail) add(r.count, r.sum, r.min, r.max);
+    }
+    if (s.count > 0) s.avg = sum / (double)s.count;
+    return s;
+}
+
+// Свёртка, записанная несколько раз, входит в квантили, только если скетч есть у
+// каждой её части - иначе он покрыл бы не весь count (как и у sqlite)
+TDigest TsdbRepo::sketch(const std::string& kind, std::int64_t from, std::int64_t to) {
+    int k = kind_index(kind);
+    if (k != 0 && !has_sketch(kind)) throw std::runtime_error("no sketch for kind");
+
+    TDigest d;
+    if (k == 0) {
+        scan(k, from, to, [&](const DbRollup& r) { d.add(r.sum); return true; });
+        return d;
+    }
+
+    std::optional<std::int64_t> cur;
+    bool whole = true;
+    TDigest run, part;
+    auto finish = [&] {
+        if (cur && whole) d.merge(run);
+    };
+    scan(k, from, to, [&](const DbRollup& r) {
+        if (cur != r.ts) {
+            finish();
+            cur = r.ts;
+            whole = true;
+            run = TDigest{};
+        }
+        if (!whole) return true;
+        if (r.sketch.empty() || !TDigest::deserialize(r.sketch.data(), r.sketch.size(), part)) whole = false;
+        else run.merge(part);
+        return true;
+    });
+    finish();
+    return d;
+}
+
+// Свёртки одного периода (записанные дважды) выходят одной точкой.
+// fn вызывается без блокировок: медленный клиент не держит запись
+void TsdbRepo::for_each(const std::string& kind, std::int64_t from, std::int64_t to,
+                        const std::function<bool(const DbPoint&)>& fn, int limit) {
+    int k = kind_index(kind);
+    if (limit == 0) return;
+
+    auto emit = [&](const DbRollup& r) {
+        if (!fn(DbPoint{r.ts, k == 0 ? r.sum : r.avg()})) return false;
+        return !(limit > 0 && --limit == 0);
+    };
+
+    if (k == 0) {
+        scan(k, from, to, emit);
+        return;
+    }
+
+    std::optional<DbRollup> cur;
+    scan(k, from, to, [&](const DbRollup& r) {
+        if (cur && cur->ts == r.ts) {
+            merge_rollup(*cur, r);
+            return true;
+        }
+        if (cur && !emit(*cur)) {
+            cur.reset();
+            return false;
+        }
+        cur = DbRollup{r.ts, r.count, r.sum, r.min, r.max};
+        return true;
+    });
+    if (cur) emit(*cur);
+}
+
+// floor сдвигается сразу, сегменты целиком раньше keep_from удаляются по одному за шаг
+bool TsdbRepo::retention_step(const std::string& kind, std::int64_t keep_from, int /*max_rows*/) {
+    int k = kind_index(kind);
+    std::lock_guard<std::mutex> wl(m_write_mu);
+
+    Series& ser = m_series[k];
+    if (keep_from > ser.floor) {
+        {
+            std::unique_lock<std::shared_mutex> lk(m_mu);
+            ser.floor = keep_from;
+        }
+        write_floor(k);
+    }
+
+    if (ser.segs.empty()) return false;
+    auto it = ser.segs.begin();
+    std::int64_t start = it->first;
+    if (start + kTsdbKinds[k].seg_sec > keep_from) return false;
+
+    std::unique_ptr<Segment> dead;
+    {
+        std::unique_lock<std::shared_mutex> lk(m_mu);
+        dead = std::move(it->second);
+        ser.segs.erase(it);
+    }
+    // закрытие и удаление файлов - уже без m_mu; снимки держат своё отображение
+    dead.reset();
+    std::error_code ec;
+    fs::remove(seg_path(k, start, ".seg"), ec);
+    fs::remove(seg_path(k, start, ".tail"), ec);
+    return true;
+}
+
+// fdatasync - под m_write_mu (файлы трогает только писатель), читателей не держит
+void TsdbRepo::sync() {
+    std::lock_guard<std::mutex> wl(m_write_mu);
+    for (auto& ser : m_series) {
+        for (auto& kv : ser.segs) kv.second->tail_out.sync();
+    }
+}
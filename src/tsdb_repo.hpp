@@ -0,0 +1,146 @@
+#pragma once
+#include "log_writer.hpp"
+#include "mapped_file.hpp"
+#include "repo.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+// Своё хранилище рядов (--storage tsdb): только дозапись, без SQL.
+// Каталог dir:
+//   <kind>/<начало>.seg   сегмент: закрытые блоки подряд, файл отображается в память.
+//                         Блок - заголовок (ts min/max, count/sum/min/max) и
+//                         Gorilla по колонкам: raw - value, свёртки - count, sum,
+//                         min, max (+ скетчи у hourly/daily)
+//   <kind>/<начало>.tail  записи открытого блока как есть; пачка - одна дозапись
+//   <kind>/floor          граница retention: записи раньше неё не видны
+//   open.0, open.1        незакрытые периоды свёрток, пишутся по очереди
+// Блок закрывается на block_records записях: дописывается в .seg, .tail обнуляется.
+// Заголовки блоков - разреженный индекс по времени в памяти: запрос
+// расжимает только блоки, пересекающие период, stats берёт целые блоки из заголовков.
+// Retention удаляет сегменты целиком, в пограничном только сдвигает floor.
+// Свёртка за уже записанный период дописывается ещё раз и сливается при чтении.
+// Писатель, обслуживание и HTTP потоки делят один объект. Запись, retention и
+// sync идут по очереди под m_write_mu - там же вся работа с файлами и fdatasync;
+// m_mu (shared_mutex) берётся только на подмену состояния в памяти и на снимок
+// для чтения. Разбор блоков и колбэки читателей - без блокировок, поэтому
+// медленный HTTP-клиент не останавливает запись.
+class TsdbRepo : public Repo {
+public:
+    explicit TsdbRepo(std::string dir);
+
+    TsdbRepo(const TsdbRepo&) = delete;
+    TsdbRepo& operator=(const TsdbRepo&) = delete;
+
+    void insert_raw(std::int64_t ts, double v) override;
+    void insert_rollup(const std::string& kind, const DbRollup& r) override;
+    void insert_raw_batch(const std::vector<DbPoint>& pts) override;
+    void write_batch(const DbBatch& b) override;
+
+    std::optional<DbRollup> open_period(const std::string& kind) override;
+    std::optional<DbPoint> latest_raw() override;
+
+    std::optional<std::int64_t> max_ts(const std::string& kind) override;
+    std::optional<std::int64_t> min_ts(const std::string& kind) override;
+
+    DbStats stats(const std::string& kind, std::int64_t from, std::int64_t to) override;
+    TDigest sketch(const std::string& kind, std::int64_t from, std::int64_t to) override;
+    void for_each(const std::string& kind, std::int64_t from, std::int64_t to,
+                  const std::function<bool(const DbPoint&)>& fn, int limit = -1) override;
+
+    // max_rows не нужен: сегмент удаляется за один unlink
+    bool retention_step(const std::string& kind, std::int64_t keep_from, int max_rows) override;
+
+    // fdatasync открытых .tail
+    void sync() override;
+
+private:
+    // Закрытый блок: где лежит и что в нём
+    struct Block {
+        std::uint64_t offset = 0;     // заголовок в .seg
+        std::uint32_t n = 0;
+        std::uint32_t flags = 0;
+        std::int64_t min_ts = 0, max_ts = 0;
+        long long count = 0;
+        double sum = 0, min = 0, max = 0;
+    };
+
+    struct Segment {
+        std::int64_t start = 0;
+        std::vector<Block> blocks;             // по смещению в файле
+        std::shared_ptr<const MappedFile> map; // .seg целиком; старое держат снимки
+        std::uint64_t seg_bytes = 0;
+        std::vector<DbRollup> tail;            // открытый блок (у raw count = 1, sum = value)
+        LogWriter tail_out;                    // дозапись .tail, сброс - в конце пачки
+        bool sorted = true;                    // все записи по порядку ts
+        std::int64_t last_ts = INT64_MIN;
+
+        explicit Segment(std::int64_t s);
+    };
+
+    struct Series {
+        std::map<std::int64_t, std::unique_ptr<Segment>> segs;
+        std::int64_t floor = INT64_MIN;
+    };
+
+    // Сегмент для чтения без блокировки: отображение + копии заголовков блоков
+    // и записей tail, пересекающих период
+    struct SegView {
+        std::shared_ptr<const MappedFile> map;
+        std::vector<Block> blocks;
+        std::vector<DbRollup> tail;
+        bool sorted = true;
+    };
+
+    std::string m_dir;
+    std::mutex m_write_mu;              // писатель и обслуживание по очереди
+    mutable std::shared_mutex m_mu;     // состояние в памяти
+    Series m_series[kKindCount];
+
+    std::optional<DbRollup> m_open[kKindCount];
+    std::uint64_t m_open_seq = 0;
+
+    std::string kind_dir(int k) const;
+    std::string seg_path(int k, std::int64_t start, const char* ext) const;
+    static std::int64_t seg_start(int k, std::int64_t ts);
+
+    void load_kind(int k);
+    void load_segment(int k, Segment& s);
+    void load_open();
+    void write_open();
+    void write_floor(int k);
+
+    Segment& segment_for_write(int k, std::int64_t ts);
+    void append(int k, const DbRollup& r, std::vector<Segment*>& touched);
+    void seal(int k, Segment& s);
+    void reset_tail(int k, Segment& s);
+
+    // Под m_mu (shared): сегменты kind, пересекающие [from, to]; from поднимается до floor
+    std::vector<SegView> snapshot(int k, std::int64_t& from, std::int64_t to) const;
+    // Записи kind с ts в [from, to] не раньше floor, по ts (равные - в порядке записи).
+    // m_mu - только на снимок; fn возвращает false - обход прекращается
+    void scan(int k, std::int64_t from, std::int64_t to, const std::function<bool(const DbRollup&)>& fn) const;
+    static bool decode_block(int k, const MappedFile& map, const Block& b, std::vector<DbRollup>& out);
+    std::optional<std::int64_t> seg_max(const Segment& s) const;
+};
+
+// Пул для HTTP: TsdbRepo сам разводит читателей и писателя, соединение одно
+class TsdbReadPool : public RepoReadPool {
+public:
+    explicit TsdbReadPool(TsdbRepo& repo) : m_repo(repo) {}
+    Lease acquire() override { return Lease(*this, m_repo); }
+
+protected:
+    void release(Repo&) override {}
+
+private:
+    TsdbRepo& m_repo;
+};
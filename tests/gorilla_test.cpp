@@ -0,0 +1,46 @@
+#include "gorilla.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+static int g_failed = 0;
+
+// Ряд с одним скачком dod: шаг 10, потом 10 + dod, потом снова 10 + dod
+static void round_trip(std::int64_t dod) {
+    std::vector<std::int64_t> ts = {1700000000, 1700000010};
+    ts.push_back(ts.back() + 10 + dod);
+    ts.push_back(ts.back() + 10 + dod);
+    ts.push_back(ts.back() + 10);
+
+    GorillaEncoder enc;
+    for (std::size_t i = 0; i < ts.size(); ++i) enc.append(ts[i], 20.0 + 0.125 * (double)i);
+
+    GorillaDecoder dec(enc.bytes().data(), enc.bytes().size(), enc.count());
+    for (std::size_t i = 0; i < ts.size(); ++i) {
+        std::int64_t t = 0;
+        double v = 0;
+        if (!dec.next(t, v) || t != ts[i] || v != 20.0 + 0.125 * (double)i) {
+            std::cerr << "dod " << dod << ": point " << i << " decoded as " << t << " " << v
+                      << ", expected " << ts[i] << "\n";
+            ++g_failed;
+            return;
+        }
+    }
+}
+
+int main() {
+    // границы полей 7, 9 и 12 бит и соседние значения
+    const std::int64_t dods[] = {
+        1, -1, 63, -63, 64, -64, 65, -65,
+        255, -255, 256, -256, 257, -257,
+        2047, -2047, 2048, -2048, 2049, -2049,
+        1000000, -1000000,
+    };
+    for (std::int64_t d : dods) round_trip(d);
+
+    if (g_failed) return 1;
+    std::cout << "gorilla: ok\n";
+    return 0;
+}
@@ -0,0 +1,214 @@
+#include "sqlite_db.hpp"
+#include "sqlite_repo.hpp"
+#include "tsdb_repo.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+static int g_failed = 0;
+
+#define CHECK(c)                                                            \
+    do {                                                                    \
+        if (!(c)) {                                                         \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " #c "\n";       \
+            ++g_failed;                                                     \
+        }                                                                   \
+    } while (0)
+
+static DbRollup rollup(const std::string& kind, std::int64_t ts, int n) {
+    TDigest d;
+    DbRollup r{ts, n, 0, 1e9, -1e9};
+    for (int i = 0; i < n; ++i) {
+        double v = 20.0 + 0.37 * (double)i;
+        d.add(v);
+        r.sum += v;
+        r.min = std::min(r.min, v);
+        r.max = std::max(r.max, v);
+    }
+    if (Repo::has_sketch(kind)) r.sketch = d.serialize();
+    return r;
+}
+
+static bool same(const std::optional<DbRollup>& a, const std::optional<DbRollup>& b) {
+    if (a.has_value() != b.has_value()) return false;
+    if (!a) return true;
+    return a->ts == b->ts && a->count == b->count && a->sum == b->sum && a->min == b->min &&
+           a->max == b->max && a->sketch == b->sketch;
+}
+
+// Незакрытые периоды всех свёрток переживают переоткрытие, из обоих слотов open.N
+static void open_periods_reload(const fs::path& dir) {
+    fs::remove_all(dir);
+    auto repo = std::make_unique<TsdbRepo>(dir.string());
+
+    std::optional<DbRollup> expected[Repo::kKindCount];
+    std::int64_t t = 1700000000;
+    for (int batch = 0; batch < 3; ++batch) {
+        DbBatch b;
+        for (int i = 0; i < 50; ++i) b.raw.push_back({t += 7, 20.0 + 0.01 * (double)i});
+        for (int k = 1; k < Repo::kKindCount; ++k) {
+            const std::string& kind = Repo::kinds()[k];
+            std::int64_t step = Repo::step_sec(kind);
+            DbRollup r = rollup(kind, (t / step) * step, 10 + batch * 5 + k);
+            expected[k] = r;
+            b.open.push_back({kind.c_str(), r});
+        }
+        repo->write_batch(b);
+
+        repo.reset();
+        repo = std::make_unique<TsdbRepo>(dir.string());
+        for (int k = 1; k < Repo::kKindCount; ++k)
+            CHECK(same(repo->open_period(Repo::kinds()[k]), expected[k]));
+    }
+}
+
+static bool near(double a, double b) {
+    return std::fabs(a - b) <= 1e-9 * std::max(1.0, std::fabs(a));
+}
+
+// TsdbRepo против SqliteRepo на тех же записях: stats, for_each, sketch, max/min_ts,
+// latest_raw и open_period на случайных периодах
+static void compare(Repo& sq, Repo& ts, std::mt19937_64& rng, std::int64_t t0, std::int64_t t1) {
+    const std::int64_t span = t1 - t0 + 1;
+    for (const auto& kind : Repo::kinds()) {
+        CHECK(sq.max_ts(kind) == ts.max_ts(kind));
+        CHECK(sq.min_ts(kind) == ts.min_ts(kind));
+        CHECK(same(sq.open_period(kind), ts.open_period(kind)));
+
+        for (int q = 0; q < 20; ++q) {
+            std::int64_t from = t0 - 1000 + (std::int64_t)(rng() % (std::uint64_t)span);
+            std::int64_t to = from + (std::int64_t)(rng() % (std::uint64_t)span);
+            if (q == 0) {
+                from = INT64_MIN;
+                to = INT64_MAX;
+            }
+
+            DbStats a = sq.stats(kind, from, to), b = ts.stats(kind, from, to);
+            CHECK(a.count == b.count);
+            if (a.count && b.count) {
+                CHECK(near(a.min, b.min));
+                CHECK(near(a.max, b.max));
+                CHECK(near(a.avg, b.avg));
+            }
+
+            int limit = q % 3 == 0 ? -1 : (int)(rng() % 50);
+            std::vector<DbPoint> pa, pb;
+            sq.for_each(kind, from, to, [&](const DbPoint& p) { pa.push_back(p); return true; }, limit);
+            ts.for_each(kind, from, to, [&](const DbPoint& p) { pb.push_back(p); return true; }, limit);
+            CHECK(pa.size() == pb.size());
+            for (std::size_t i = 0; i < std::min(pa.size(), pb.size()); ++i) {
+                CHECK(pa[i].ts == pb[i].ts);
+                // raw с равными ts: порядок внутри группы у хранилищ не обязан совпадать
+                bool tie = kind == "raw" && ((i + 1 < pa.size() && pa[i + 1].ts == pa[i].ts) ||
+                                             (i > 0 && pa[i - 1].ts == pa[i].ts));
+                if (!tie) CHECK(near(pa[i].value, pb[i].value));
+            }
+
+            if (kind == "raw" || Repo::has_sketch(kind)) {
+                TDigest da = sq.sketch(kind, from, to), db = ts.sketch(kind, from, to);
+                CHECK(near(da.count(), db.count()));
+                if (da.count() > 0) CHECK(std::fabs(da.quantile(0.5) - db.quantile(0.5)) <= 0.5);
+            }
+        }
+    }
+
+    auto la = sq.latest_raw(), lb = ts.latest_raw();
+    CHECK(la.has_value() == lb.has_value());
+    if (la && lb) CHECK(la->ts == lb->ts);
+}
+
+// Пачка: raw с шагом 1..20 с (back - с часами, ушедшими назад посреди пачки),
+// закрытые свёртки, в том числе за уже записанные периоды, и незакрытые периоды
+static DbBatch random_batch(std::mt19937_64& rng, std::int64_t& t, bool back) {
+    DbBatch b;
+    int n = 1 + (int)(rng() % 300);
+    for (int i = 0; i < n; ++i) {
+        t += 1 + (std::int64_t)(rng() % 20);
+        if (back && i == n / 2) t -= 5000;
+        double v = rng() % 3 == 0 ? 20.0 + (double)(rng() % 1000) / 7.0 : 20.0 + (double)(rng() % 10000) / 1000.0;
+        b.raw.push_back({t, v});
+    }
+    std::vector<DbRollup>* closed[Repo::kKindCount] = {nullptr, &b.m1, &b.m5, &b.hourly, &b.daily};
+    for (int k = 1; k < Repo::kKindCount; ++k) {
+        const std::string& kind = Repo::kinds()[k];
+        if (k > 2 && rng() % 4 != 0) continue;
+        std::int64_t step = Repo::step_sec(kind);
+        std::int64_t period = (t / step) * step;
+        int count = 1 + (int)(rng() % 10);
+        closed[k]->push_back(rollup(kind, period - step * (std::int64_t)(rng() % 3), count));
+        b.open.push_back({kind.c_str(), rollup(kind, period + step, count + 1)});
+    }
+    return b;
+}
+
+// Одни и те же пачки в оба хранилища; сверка до и после переоткрытия tsdb,
+// после retention и после мусора в конце .seg/.tail (обрыв записи)
+static void matches_sqlite(const fs::path& dir) {
+    const fs::path tsdb_dir = dir / "t.tsdb";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+
+    SqliteDb db((dir / "t.db").string());
+    SqliteRepo sq(db);
+    sq.init_schema();
+    auto ts = std::make_unique<TsdbRepo>(tsdb_dir.string());
+
+    std::mt19937_64 rng(42);
+    const std::int64_t t0 = 1700000000;
+    std::int64_t t = t0;
+    for (int round = 0; round < 5; ++round) {
+        for (int i = 0; i < 100; ++i) {
+            DbBatch b = random_batch(rng, t, round == 2 && i == 50);
+            sq.write_batch(b);
+            ts->write_batch(b);
+        }
+        compare(sq, *ts, rng, t0, t);
+
+        ts.reset();
+        ts = std::make_unique<TsdbRepo>(tsdb_dir.string());
+        compare(sq, *ts, rng, t0, t);
+
+        if (round >= 3) {
+            std::int64_t keep = t0 + (t - t0) / 3 + round * 10000;
+            for (const auto& kind : Repo::kinds()) {
+                sq.retention(kind, keep);
+                ts->retention(kind, keep);
+            }
+            compare(sq, *ts, rng, t0, t);
+        }
+    }
+
+    ts->sync();
+    ts.reset();
+    for (const auto& e : fs::recursive_directory_iterator(tsdb_dir)) {
+        if (e.path().extension() != ".seg" && e.path().extension() != ".tail") continue;
+        if (std::FILE* f = std::fopen(e.path().string().c_str(), "ab")) {
+            std::fwrite("garbage", 1, 7, f);
+            std::fclose(f);
+        }
+    }
+    ts = std::make_unique<TsdbRepo>(tsdb_dir.string());
+    compare(sq, *ts, rng, t0, t);
+}
+
+int main() {
+    const fs::path dir = fs::temp_directory_path() / "tsdb_test";
+    open_periods_reload(dir);
+    matches_sqlite(dir);
+    fs::remove_all(dir);
+
+    if (g_failed) return 1;
+    std::cout << "tsdb: ok\n";
+    return 0;
+}